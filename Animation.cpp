@@ -0,0 +1,270 @@
+#include "Animation.hpp"
+
+#include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+AnimationClip::AnimationClip(std::string const &filename) {
+	load(filename);
+}
+
+AnimationClip AnimationClip::compress(float frame_rate, std::vector< Samples > const &samples, float tolerance) {
+	AnimationClip clip;
+	clip.frame_rate = frame_rate;
+	for (auto const &s : samples) {
+		clip.frames = std::max(clip.frames, uint32_t(s.values.size()));
+	}
+	if (clip.frames > 0x10000) throw std::runtime_error("Clip has more frames than 16-bit key frames can address.");
+
+	for (auto const &s : samples) {
+		if (s.values.empty()) throw std::runtime_error("Track '" + s.name + "' has no samples.");
+		std::vector< glm::vec4 > values = s.values;
+		uint32_t count = uint32_t(values.size());
+
+		//rotations are normalized and sign-flipped to follow the shortest path, so keys can simply be interpolated:
+		if (s.channel == Rotation) {
+			for (uint32_t i = 0; i < count; ++i) {
+				values[i] = glm::normalize(values[i]);
+				if (i > 0 && glm::dot(values[i], values[i-1]) < 0.0f) values[i] = -values[i];
+			}
+		}
+
+		Track track;
+		track.name = s.name;
+		track.channel = s.channel;
+
+		//quantize over the track's range (rotation components are always in [-1,1]):
+		if (s.channel == Rotation) {
+			track.base = glm::vec4(-1.0f);
+			track.step = glm::vec4(2.0f / 65535.0f);
+		} else {
+			glm::vec4 min = values[0];
+			glm::vec4 max = values[0];
+			for (auto const &v : values) {
+				min = glm::min(min, v);
+				max = glm::max(max, v);
+			}
+			track.base = min;
+			track.step = (max - min) / 65535.0f;
+		}
+		std::vector< glm::u16vec4 > quantized(count);
+		std::vector< glm::vec4 > dequantized(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			for (uint32_t c = 0; c < 4; ++c) {
+				float q = (track.step[c] > 0.0f ? std::round((values[i][c] - track.base[c]) / track.step[c]) : 0.0f);
+				quantized[i][c] = uint16_t(glm::clamp(q, 0.0f, 65535.0f));
+			}
+			dequantized[i] = track.base + track.step * glm::vec4(quantized[i]);
+		}
+
+		//interpolation exactly as AnimationPlayer::apply does it:
+		auto interpolate = [&s](glm::vec4 const &a, glm::vec4 const &b, float amt) {
+			glm::vec4 v = a + (b - a) * amt;
+			if (s.channel == Rotation) v = glm::normalize(v);
+			return v;
+		};
+		//can keys at k and j stand in for every sample between them?
+		auto fits = [&](uint32_t k, uint32_t j) {
+			for (uint32_t i = k + 1; i < j; ++i) {
+				glm::vec4 v = interpolate(dequantized[k], dequantized[j], float(i - k) / float(j - k));
+				for (uint32_t c = 0; c < 4; ++c) {
+					if (std::abs(v[c] - values[i][c]) > tolerance) return false;
+				}
+			}
+			return true;
+		};
+
+		//greedily keep the farthest key that still fits, starting from the first frame:
+		track.key_begin = uint32_t(clip.key_frames.size());
+		uint32_t key = 0;
+		clip.key_frames.emplace_back(uint16_t(key));
+		clip.key_values.emplace_back(quantized[key]);
+		while (key + 1 < count) {
+			uint32_t next = key + 1;
+			for (uint32_t j = key + 2; j < count && fits(key, j); ++j) {
+				next = j;
+			}
+			key = next;
+			clip.key_frames.emplace_back(uint16_t(key));
+			clip.key_values.emplace_back(quantized[key]);
+		}
+		track.key_end = uint32_t(clip.key_frames.size());
+
+		clip.tracks.emplace_back(track);
+	}
+
+	return clip;
+}
+
+void AnimationClip::load(std::string const &filename) {
+	MappedFile file(filename);
+	ChunkReader reader(file.begin(), file.end());
+
+	ChunkSpan< ClipInfo > info = reader.read< ClipInfo >("anm0");
+	if (info.size() != 1) throw std::runtime_error("Expected exactly one clip in '" + filename + "'.");
+	if (!(info[0].frame_rate > 0.0f)) throw std::runtime_error("Clip in '" + filename + "' has invalid frame rate.");
+	ChunkSpan< char > names = reader.read< char >("str0");
+	ChunkSpan< TrackEntry > entries = reader.read< TrackEntry >("trk0");
+	ChunkSpan< uint16_t > frames_in = reader.read< uint16_t >("kft0");
+	ChunkSpan< glm::u16vec4 > values_in = reader.read< glm::u16vec4 >("kfv0");
+	if (frames_in.size() != values_in.size()) {
+		throw std::runtime_error("Clip in '" + filename + "' has mismatched key frame and key value counts.");
+	}
+	if (!reader.at_end()) {
+		throw std::runtime_error("Trailing data in animation file '" + filename + "'.");
+	}
+
+	frame_rate = info[0].frame_rate;
+	frames = info[0].frames;
+	tracks.clear();
+	tracks.reserve(entries.size());
+	for (auto const &entry : entries) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= names.size())) {
+			throw std::runtime_error("track entry has out-of-range name begin/end");
+		}
+		if (entry.channel > Scale) {
+			throw std::runtime_error("track entry has unknown channel");
+		}
+		if (!(entry.key_begin < entry.key_end && entry.key_end <= frames_in.size())) {
+			throw std::runtime_error("track entry has out-of-range key begin/end");
+		}
+		for (uint32_t k = entry.key_begin; k < entry.key_end; ++k) {
+			if (frames_in[k] >= frames || (k > entry.key_begin && frames_in[k] <= frames_in[k-1])) {
+				throw std::runtime_error("track has out-of-order or out-of-range key frames");
+			}
+		}
+		Track track;
+		track.name = std::string(names.data() + entry.name_begin, names.data() + entry.name_end);
+		track.channel = Channel(entry.channel);
+		track.key_begin = entry.key_begin;
+		track.key_end = entry.key_end;
+		track.base = entry.base;
+		track.step = entry.step;
+		tracks.emplace_back(track);
+	}
+	key_frames.assign(frames_in.begin(), frames_in.end());
+	key_values.assign(values_in.begin(), values_in.end());
+}
+
+void AnimationClip::save(std::ostream *to) const {
+	std::vector< ClipInfo > info{ClipInfo{frame_rate, frames}};
+
+	std::vector< char > names;
+	std::vector< TrackEntry > entries;
+	entries.reserve(tracks.size());
+	for (auto const &track : tracks) {
+		TrackEntry entry;
+		entry.name_begin = uint32_t(names.size());
+		names.insert(names.end(), track.name.begin(), track.name.end());
+		entry.name_end = uint32_t(names.size());
+		entry.channel = track.channel;
+		entry.key_begin = track.key_begin;
+		entry.key_end = track.key_end;
+		entry.base = track.base;
+		entry.step = track.step;
+		entries.emplace_back(entry);
+	}
+
+	write_chunk("anm0", info, to);
+	write_chunk("str0", names, to);
+	write_chunk("trk0", entries, to);
+	write_chunk("kft0", key_frames, to);
+	write_chunk("kfv0", key_values, to);
+}
+
+//-------------------------
+
+AnimationPlayer::AnimationPlayer(AnimationClip const &clip_, Scene &scene) : clip(clip_) {
+	for (uint32_t t = 0; t < clip.tracks.size(); ++t) {
+		AnimationClip::Track const &track = clip.tracks[t];
+		Scene::Transform *target = scene.find(track.name);
+		if (!target) continue;
+		bindings[track.channel].emplace_back(Binding{t, target, track.key_begin});
+	}
+}
+
+void AnimationPlayer::advance(float elapsed) {
+	float duration = clip.duration();
+	time += elapsed;
+	if (loop && duration > 0.0f) {
+		time = std::fmod(time, duration);
+		if (time < 0.0f) time += duration;
+	} else {
+		time = glm::clamp(time, 0.0f, duration);
+	}
+}
+
+uint32_t AnimationPlayer::seek(AnimationClip::Track const &track, uint32_t cursor, float frame) const {
+	std::vector< uint16_t > const &key_frames = clip.key_frames;
+	if (cursor < track.key_begin || cursor >= track.key_end || float(key_frames[cursor]) > frame) {
+		//playhead moved backwards (e.g., looped): search the whole track:
+		auto begin = key_frames.begin() + track.key_begin;
+		auto end = key_frames.begin() + track.key_end;
+		auto after = std::upper_bound(begin, end, frame, [](float f, uint16_t k) { return f < float(k); });
+		return (after == begin ? track.key_begin : uint32_t(after - key_frames.begin()) - 1);
+	}
+	//sequential playback: step forward from the cursor:
+	while (cursor + 1 < track.key_end && float(key_frames[cursor + 1]) <= frame) {
+		++cursor;
+	}
+	return cursor;
+}
+
+void AnimationPlayer::apply(float weight) {
+	if (clip.frames == 0) return;
+	float frame = glm::clamp(time * clip.frame_rate, 0.0f, float(clip.frames - 1));
+
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		std::vector< Binding > &batch = bindings[channel];
+		if (batch.empty()) continue;
+		uint32_t count = uint32_t(batch.size());
+		from.resize(count);
+		to.resize(count);
+		values.resize(count);
+		amount.resize(count);
+
+		//find the keys around 'frame' for every track:
+		for (uint32_t i = 0; i < count; ++i) {
+			Binding &binding = batch[i];
+			AnimationClip::Track const &track = clip.tracks[binding.track];
+			binding.cursor = seek(track, binding.cursor, frame);
+			uint32_t key = binding.cursor;
+			from[i] = clip.key_value(track, key);
+			if (key + 1 < track.key_end) {
+				float f0 = float(clip.key_frames[key]);
+				float f1 = float(clip.key_frames[key + 1]);
+				to[i] = clip.key_value(track, key + 1);
+				amount[i] = glm::clamp((frame - f0) / (f1 - f0), 0.0f, 1.0f);
+			} else {
+				to[i] = from[i];
+				amount[i] = 0.0f;
+			}
+		}
+
+		//interpolate the whole batch (simple loops over flat arrays, so the compiler can vectorize them):
+		for (uint32_t i = 0; i < count; ++i) {
+			values[i] = from[i] + (to[i] - from[i]) * amount[i];
+		}
+		if (channel == AnimationClip::Rotation) {
+			for (uint32_t i = 0; i < count; ++i) {
+				values[i] *= 1.0f / std::sqrt(std::max(glm::dot(values[i], values[i]), 1.0e-12f));
+			}
+		}
+
+		//write to transforms:
+		for (uint32_t i = 0; i < count; ++i) {
+			Scene::Transform &target = *batch[i].target;
+			glm::vec4 const &v = values[i];
+			if (channel == AnimationClip::Rotation) {
+				glm::quat rotation = glm::quat(v.w, v.x, v.y, v.z);
+				target.rotation = (weight >= 1.0f ? rotation : glm::slerp(target.rotation, rotation, weight));
+			} else {
+				glm::vec3 &value = (channel == AnimationClip::Position ? target.position : target.scale);
+				value = (weight >= 1.0f ? glm::vec3(v) : glm::mix(value, glm::vec3(v), weight));
+			}
+		}
+	}
+}
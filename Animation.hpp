@@ -0,0 +1,128 @@
+#pragma once
+
+/*
+ * Keyframe animation of scene transforms.
+ *
+ * An AnimationClip holds position/rotation/scale tracks for named transforms.
+ *  Tracks are stored compressed: values are quantized to 16 bits per component,
+ *  and only the keys that linear interpolation can't reproduce (within a tolerance)
+ *  are kept. Clips are built from densely-sampled tracks with AnimationClip::compress.
+ *
+ * An AnimationPlayer binds a clip's tracks to a scene's transforms (by name) and
+ *  plays it back: advance() moves the playhead, apply() writes the sampled pose.
+ *  Applying a second player with a weight blends its clip over the first:
+ *    walk.apply(); run.apply(0.25f); //75% walk, 25% run
+ *
+ * Clip files are a sequence of chunks (see read_write_chunk.hpp):
+ *   anm0 - ClipInfo (exactly one)
+ *   str0 - track names
+ *   trk0 - TrackEntry for each track
+ *   kft0 - key frame numbers (uint16 each)
+ *   kfv0 - quantized key values (u16vec4 each)
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct AnimationClip {
+	enum Channel : uint32_t {
+		Position = 0,
+		Rotation = 1, //stored as (x,y,z,w)
+		Scale = 2,
+	};
+
+	//load from a file (throws on error):
+	AnimationClip(std::string const &filename);
+	AnimationClip() = default;
+
+	float frame_rate = 30.0f; //frames per second
+	uint32_t frames = 0; //number of frames; playback covers frame 0 .. frames-1
+	float duration() const { return (frames > 1 ? float(frames - 1) / frame_rate : 0.0f); }
+
+	struct Track {
+		std::string name; //name of the transform this track animates
+		Channel channel = Position;
+		uint32_t key_begin = 0, key_end = 0; //range of key_frames / key_values
+		//key value = base + step * quantized value:
+		glm::vec4 base = glm::vec4(0.0f);
+		glm::vec4 step = glm::vec4(0.0f);
+	};
+	std::vector< Track > tracks;
+	std::vector< uint16_t > key_frames; //increasing within each track; each track has keys at its first and last frame
+	std::vector< glm::u16vec4 > key_values;
+
+	glm::vec4 key_value(Track const &track, uint32_t key) const {
+		return track.base + track.step * glm::vec4(key_values[key]);
+	}
+
+	//build a clip from tracks sampled at every frame:
+	struct Samples {
+		std::string name;
+		Channel channel = Position;
+		std::vector< glm::vec4 > values; //one per frame (xyz for position/scale; xyzw for rotation)
+	};
+	//keys are dropped wherever interpolating between the kept keys stays within 'tolerance'
+	// (per component, after quantization) of every sample:
+	static AnimationClip compress(float frame_rate, std::vector< Samples > const &samples, float tolerance = 1.0e-3f);
+
+	//file I/O:
+	void load(std::string const &filename);
+	void save(std::ostream *to) const;
+
+	//--- file format ---
+	struct ClipInfo { //anm0
+		float frame_rate;
+		uint32_t frames;
+	};
+	static_assert(sizeof(ClipInfo) == 4 + 4, "ClipInfo is packed.");
+
+	struct TrackEntry { //trk0
+		uint32_t name_begin, name_end; //in str0
+		uint32_t channel;
+		uint32_t key_begin, key_end; //in kft0 / kfv0
+		glm::vec4 base;
+		glm::vec4 step;
+	};
+	static_assert(sizeof(TrackEntry) == 4*5 + 4*4 + 4*4, "TrackEntry is packed.");
+};
+
+struct AnimationPlayer {
+	//bind clip tracks to the transforms of 'scene' with the same names:
+	// (tracks for names the scene doesn't have are ignored)
+	AnimationPlayer(AnimationClip const &clip, Scene &scene);
+
+	AnimationClip const &clip;
+	float time = 0.0f; //in seconds
+	bool loop = true; //wrap time around at the end of the clip (otherwise hold the last frame)
+
+	//move the playhead:
+	void advance(float elapsed);
+	bool done() const { return !loop && time >= clip.duration(); }
+
+	//sample the clip at 'time' and write the result into the bound transforms:
+	// weight < 1 blends from the transforms' current values toward the clip's
+	void apply(float weight = 1.0f);
+
+	//--- internals ---
+	//tracks bound to transforms, grouped by channel so each channel is evaluated as one batch:
+	struct Binding {
+		uint32_t track; //index into clip.tracks
+		Scene::Transform *target;
+		uint32_t cursor; //key at or before the most recently sampled frame (sequential playback only steps forward)
+	};
+	std::vector< Binding > bindings[3]; //indexed by AnimationClip::Channel
+
+	//per-batch scratch: the keys on either side of the frame, and how far between them it is:
+	std::vector< glm::vec4 > from, to, values;
+	std::vector< float > amount;
+
+	//key index for 'frame' in a track, starting the search from 'cursor':
+	uint32_t seek(AnimationClip::Track const &track, uint32_t cursor, float frame) const;
+};
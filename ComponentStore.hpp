@@ -0,0 +1,199 @@
+#pragma once
+
+/*
+ * ComponentStore keeps a scene's components (Scene::Drawable, Camera, Light)
+ *  in one contiguous array, so per-frame passes stream through memory
+ *  instead of hopping between list nodes.
+ *
+ * Components are removed by moving the last component into the hole
+ *  ("swap-remove"), so removal is O(1) but doesn't preserve order.
+ * Since the array may move or reorder, pointers and references to components
+ *  are only valid until the next add or remove; Handles stay valid until
+ *  their own component is removed.
+ *
+ * 'version' changes whenever the array changes shape (add, remove, assignment),
+ *  so things built over the array (e.g., Scene's draw list) can tell when to rebuild.
+ *
+ * Rarely-touched ("cold") parts of a component can be kept apart from it, in a
+ *  side array indexed by handle slot (see cold()), so passes over the array
+ *  only stream through the hot fields. Cold data doesn't move when components
+ *  are swap-removed; references to it are valid until the next add.
+ *
+ * Copies of a store share their cold data (copy-on-write): copying only copies
+ *  the hot array, and the side array is cloned the first time either copy adds,
+ *  removes, or asks for a non-const reference to cold data. (So a non-const
+ *  reference taken before the store was copied would write to both copies --
+ *  get a new one after copying.)
+ *
+ * The interface mirrors the parts of std::list that scene code uses
+ *  (emplace_back, front, back, iteration, remove_if, clear).
+ *
+ */
+
+#include "Handle.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+//(for stores without cold data)
+struct NoColdData { };
+
+template< typename T, typename Cold = NoColdData >
+struct ComponentStore {
+	//Handles refer to components independent of their current array index:
+	using Handle = ::Handle;
+
+	ComponentStore() = default;
+	ComponentStore(ComponentStore const &) = default;
+	ComponentStore &operator=(ComponentStore const &other) {
+		if (this == &other) return *this;
+		uint32_t next_version = version + 1;
+		items = other.items;
+		slot_of = other.slot_of;
+		slots = other.slots;
+		free_slots = other.free_slots;
+		cold_data = other.cold_data; //(shared until one of the stores changes it)
+		version = next_version;
+		return *this;
+	}
+
+	//add a component at the end of the array:
+	template< typename... Args >
+	T &emplace_back(Args &&... args) {
+		uint32_t slot;
+		if (!free_slots.empty()) {
+			slot = free_slots.back();
+			free_slots.pop_back();
+		} else {
+			slot = uint32_t(slots.size());
+			slots.emplace_back();
+			own_cold().emplace_back();
+		}
+		slots[slot].index = uint32_t(items.size());
+		items.emplace_back(std::forward< Args >(args)...);
+		slot_of.emplace_back(slot);
+		version += 1;
+		return items.back();
+	}
+
+	//handle for a component in this store:
+	Handle handle(T const &component) const {
+		uint32_t slot = slot_of[index_of(component)];
+		return Handle(slot, slots[slot].generation);
+	}
+
+	bool valid(Handle h) const {
+		return h.slot < slots.size() && slots[h.slot].generation == h.generation && slots[h.slot].index != -1U;
+	}
+	//component for a handle (or nullptr if it has been removed):
+	T *get(Handle h) { return valid(h) ? &items[slots[h.slot].index] : nullptr; }
+	T const *get(Handle h) const { return valid(h) ? &items[slots[h.slot].index] : nullptr; }
+
+	//cold data of a component (reset to Cold() when the component is removed):
+	// (the non-const versions clone cold data shared with another store first)
+	Cold &cold(Handle h) { assert(valid(h)); return own_cold()[h.slot]; }
+	Cold const &cold(Handle h) const { assert(valid(h)); return (*cold_data)[h.slot]; }
+	Cold &cold(T const &component) { return own_cold()[slot_of[index_of(component)]]; }
+	Cold const &cold(T const &component) const { return (*cold_data)[slot_of[index_of(component)]]; }
+	//is the cold data shared with a copy of this store?
+	bool cold_shared() const { return cold_data.use_count() > 1; }
+
+	//swap-remove a component:
+	void remove(Handle h) {
+		if (!valid(h)) return;
+		remove_at(slots[h.slot].index);
+	}
+	void remove(T const &component) {
+		remove(handle(component));
+	}
+
+	//swap-remove every component for which pred(component) is true:
+	template< typename Pred >
+	void remove_if(Pred const &pred) {
+		for (uint32_t i = 0; i < items.size(); /* later */) {
+			if (pred(items[i])) remove_at(i); //(re-checks index i, which now holds what was the last component)
+			else ++i;
+		}
+	}
+
+	void clear() {
+		for (uint32_t slot : slot_of) {
+			own_cold()[slot] = Cold();
+			slots[slot].index = -1U;
+			slots[slot].generation += 1;
+			free_slots.emplace_back(slot);
+		}
+		items.clear();
+		slot_of.clear();
+		version += 1;
+	}
+
+	void reserve(size_t count) {
+		items.reserve(count);
+		slot_of.reserve(count);
+	}
+
+	//array access:
+	size_t size() const { return items.size(); }
+	bool empty() const { return items.empty(); }
+	T &operator[](size_t i) { return items[i]; }
+	T const &operator[](size_t i) const { return items[i]; }
+	T &front() { return items.front(); }
+	T const &front() const { return items.front(); }
+	T &back() { return items.back(); }
+	T const &back() const { return items.back(); }
+	typename std::vector< T >::iterator begin() { return items.begin(); }
+	typename std::vector< T >::iterator end() { return items.end(); }
+	typename std::vector< T >::const_iterator begin() const { return items.begin(); }
+	typename std::vector< T >::const_iterator end() const { return items.end(); }
+
+	//--- internals ---
+	std::vector< T > items; //the components, densely packed
+	std::vector< uint32_t > slot_of; //array index -> slot
+	struct Slot {
+		uint32_t index = -1U; //array index, or -1U if slot is free
+		uint32_t generation = 0; //incremented when slot is freed
+	};
+	std::vector< Slot > slots;
+	std::vector< uint32_t > free_slots;
+	std::shared_ptr< std::vector< Cold > > cold_data = std::make_shared< std::vector< Cold > >(); //slot -> cold data (shared by copies)
+	uint32_t version = 0;
+
+	//cold data array, cloned first if another store shares it:
+	// (cloning moves this store's cold data, so it counts as a change of shape)
+	std::vector< Cold > &own_cold() {
+		if (cold_data.use_count() > 1) {
+			cold_data = std::make_shared< std::vector< Cold > >(*cold_data);
+			version += 1;
+		}
+		return *cold_data;
+	}
+
+	size_t index_of(T const &component) const {
+		assert(&component >= items.data() && &component < items.data() + items.size());
+		return size_t(&component - items.data());
+	}
+
+	void remove_at(uint32_t index) {
+		assert(index < items.size());
+		Slot &slot = slots[slot_of[index]];
+		own_cold()[slot_of[index]] = Cold();
+		slot.index = -1U;
+		slot.generation += 1;
+		free_slots.emplace_back(slot_of[index]);
+
+		uint32_t last = uint32_t(items.size()) - 1;
+		if (index != last) {
+			items[index] = std::move(items[last]);
+			slot_of[index] = slot_of[last];
+			slots[slot_of[index]].index = index;
+		}
+		items.pop_back();
+		slot_of.pop_back();
+		version += 1;
+	}
+};
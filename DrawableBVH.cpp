@@ -0,0 +1,245 @@
+#include "DrawableBVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+void DrawableBVH::build(Scene const &scene) {
+	items.clear();
+	nodes.clear();
+	built_scene = &scene;
+	built_version = scene.drawables.version;
+
+	items.reserve(scene.drawables.size());
+	uint32_t check = Scene::new_world_check(); //(so ancestors shared by many drawables are checked once)
+	for (auto const &drawable : scene.drawables) {
+		Item item;
+		item.drawable = &drawable;
+		drawable.transform->update_world_cache(check);
+		compute_bounds(&item);
+		items.emplace_back(item);
+	}
+	if (items.empty()) return;
+
+	nodes.reserve(2 * (items.size() / MaxLeafItems + 1));
+	nodes.emplace_back();
+	build_node(0, 0, uint32_t(items.size()), 0);
+}
+
+void DrawableBVH::update(Scene const &scene) {
+	//(any add, remove, or copy changes the drawables' version -- and may move them -- so a matching version
+	// means the item pointers are still good)
+	if (built_scene == &scene && built_version == scene.drawables.version) refit();
+	else build(scene);
+}
+
+void DrawableBVH::refit() {
+	bool changed = false;
+	uint32_t check = Scene::new_world_check(); //(so ancestors shared by many drawables are checked once)
+	for (auto &item : items) {
+		Scene::Transform const &transform = *item.drawable->transform;
+		//(brings ancestors up to date too, so a drawable whose parent moved gets a new generation)
+		transform.update_world_cache(check);
+		if (transform.world_cache.generation != item.generation) {
+			compute_bounds(&item);
+			changed = true;
+		}
+	}
+	if (changed) refit_nodes();
+}
+
+void DrawableBVH::compute_bounds(Item *item_) {
+	assert(item_);
+	Item &item = *item_;
+	Scene::Drawable const &drawable = *item.drawable;
+
+	glm::mat4x3 const &local_to_world = drawable.transform->world_cache.local_to_world;
+	item.generation = drawable.transform->world_cache.generation;
+
+	if (!(drawable.min.x <= drawable.max.x)) {
+		item.min = item.max = local_to_world[3];
+		return;
+	}
+
+	//transform box center, and take extent along each world axis from the (absolute value of the) rotation/scale part:
+	glm::vec3 center = local_to_world * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+	glm::vec3 radius = 0.5f * (drawable.max - drawable.min);
+	glm::vec3 extent = glm::abs(local_to_world[0]) * radius.x
+	                 + glm::abs(local_to_world[1]) * radius.y
+	                 + glm::abs(local_to_world[2]) * radius.z;
+	item.min = center - extent;
+	item.max = center + extent;
+}
+
+void DrawableBVH::build_node(uint32_t node, uint32_t begin, uint32_t end, uint32_t depth) {
+	assert(begin < end);
+
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	glm::vec3 centroid_min = min;
+	glm::vec3 centroid_max = max;
+	for (uint32_t i = begin; i < end; ++i) {
+		min = glm::min(min, items[i].min);
+		max = glm::max(max, items[i].max);
+		glm::vec3 centroid = 0.5f * (items[i].min + items[i].max);
+		centroid_min = glm::min(centroid_min, centroid);
+		centroid_max = glm::max(centroid_max, centroid);
+	}
+	nodes[node].min = min;
+	nodes[node].max = max;
+
+	if (end - begin <= MaxLeafItems || depth == MaxDepth) {
+		nodes[node].first = begin;
+		nodes[node].count = end - begin;
+		return;
+	}
+
+	//split at the median centroid along the axis where centroids are most spread out:
+	glm::vec3 spread = centroid_max - centroid_min;
+	uint32_t axis = 0;
+	if (spread.y > spread[axis]) axis = 1;
+	if (spread.z > spread[axis]) axis = 2;
+	uint32_t mid = begin + (end - begin) / 2;
+	std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end, [axis](Item const &a, Item const &b) {
+		return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis];
+	});
+
+	uint32_t left = uint32_t(nodes.size());
+	nodes.emplace_back();
+	nodes.emplace_back();
+	nodes[node].first = left;
+	nodes[node].count = 0;
+
+	build_node(left, begin, mid, depth + 1);
+	build_node(left + 1, mid, end, depth + 1);
+}
+
+void DrawableBVH::refit_nodes() {
+	//children come after parents, so a reverse sweep sees children first:
+	for (uint32_t n = uint32_t(nodes.size()) - 1; n < nodes.size(); --n) {
+		Node &node = nodes[n];
+		if (node.count != 0) {
+			node.min = items[node.first].min;
+			node.max = items[node.first].max;
+			for (uint32_t i = node.first + 1; i < node.first + node.count; ++i) {
+				node.min = glm::min(node.min, items[i].min);
+				node.max = glm::max(node.max, items[i].max);
+			}
+		} else {
+			node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+			node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+		}
+	}
+}
+
+template< typename Overlaps, typename Visit >
+void DrawableBVH::traverse(Overlaps const &overlaps, Visit const &visit) const {
+	if (nodes.empty()) return;
+
+	//the stack holds at most one pending sibling per level above the current node, plus its two children,
+	// so the depth cap in build_node() bounds it:
+	uint32_t stack[MaxDepth + 1];
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		Node const &node = nodes[stack[--top]];
+		if (!overlaps(node.min, node.max)) continue;
+		if (node.count != 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (overlaps(items[i].min, items[i].max)) visit(items[i]);
+			}
+		} else {
+			assert(top + 2 <= MaxDepth + 1);
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+		}
+	}
+}
+
+void DrawableBVH::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::vector< RayHit > *hits_) const {
+	assert(hits_);
+	auto &hits = *hits_;
+	size_t first_hit = hits.size();
+
+	//slab test:
+	// (axes the ray is parallel to are checked directly -- their infinite inverses would give 0 * inf = NaN
+	//  for an origin on a slab plane)
+	glm::vec3 inv_direction = 1.0f / direction;
+	float t = 0.0f; //entry t of most recent overlap test
+	auto overlaps = [&](glm::vec3 const &min, glm::vec3 const &max) {
+		float enter = 0.0f;
+		float exit = max_t;
+		for (uint32_t a = 0; a < 3; ++a) {
+			if (direction[a] == 0.0f) {
+				if (origin[a] < min[a] || origin[a] > max[a]) return false;
+				continue;
+			}
+			float t0 = (min[a] - origin[a]) * inv_direction[a];
+			float t1 = (max[a] - origin[a]) * inv_direction[a];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		t = enter;
+		return enter <= exit;
+	};
+	traverse(overlaps, [&](Item const &item) {
+		hits.emplace_back(RayHit{item.drawable, t});
+	});
+
+	std::sort(hits.begin() + first_hit, hits.end(), [](RayHit const &a, RayHit const &b) {
+		return a.t < b.t;
+	});
+}
+
+void DrawableBVH::query_box(glm::vec3 const &box_min, glm::vec3 const &box_max, std::vector< Scene::Drawable const * > *results_) const {
+	assert(results_);
+	auto &results = *results_;
+	traverse([&](glm::vec3 const &min, glm::vec3 const &max) {
+		return min.x <= box_max.x && min.y <= box_max.y && min.z <= box_max.z
+		    && box_min.x <= max.x && box_min.y <= max.y && box_min.z <= max.z;
+	}, [&](Item const &item) {
+		results.emplace_back(item.drawable);
+	});
+}
+
+void DrawableBVH::query_sphere(glm::vec3 const &center, float radius, std::vector< Scene::Drawable const * > *results_) const {
+	assert(results_);
+	auto &results = *results_;
+	traverse([&](glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 to_closest = glm::clamp(center, min, max) - center;
+		return glm::dot(to_closest, to_closest) <= radius * radius;
+	}, [&](Item const &item) {
+		results.emplace_back(item.drawable);
+	});
+}
+
+void DrawableBVH::query_frustum(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > *results_) const {
+	assert(results_);
+	auto &results = *results_;
+
+	//frustum planes (inside is dot(plane, (p,1)) >= 0) are sums and differences of the matrix's rows:
+	glm::vec4 rows[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	}
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2],
+	};
+
+	traverse([&](glm::vec3 const &min, glm::vec3 const &max) {
+		//box is outside if its corner furthest along a plane's normal is behind that plane:
+		for (auto const &plane : planes) {
+			glm::vec3 corner = glm::vec3(
+				(plane.x >= 0.0f ? max.x : min.x),
+				(plane.y >= 0.0f ? max.y : min.y),
+				(plane.z >= 0.0f ? max.z : min.z)
+			);
+			if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+		}
+		return true;
+	}, [&](Item const &item) {
+		results.emplace_back(item.drawable);
+	});
+}
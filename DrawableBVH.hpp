@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * DrawableBVH is a bounding volume hierarchy over the world-space bounds
+ *  of a scene's drawables, for answering "which drawables are near here?"
+ *  without walking every drawable.
+ *
+ * Build it with build(scene), then call update(scene) each frame:
+ *  if the drawables are the same as at build time, it refits the existing
+ *  tree to their current world bounds -- whether their own transforms or
+ *  any ancestors moved (cheap, but the tree gets looser as things move
+ *  around); otherwise it rebuilds the tree from scratch.
+ *  (no Scene::update_world_caches() is needed first: world caches are
+ *  brought up to date as drawables are visited)
+ *
+ * Drawables with empty (unknown) bounds are treated as a point at their origin.
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct DrawableBVH {
+	//build the tree from scratch:
+	void build(Scene const &scene);
+
+	//refit to moved transforms (or rebuild if the scene's drawables changed since build):
+	void update(Scene const &scene);
+
+	//refit node bounds to drawables' current world bounds:
+	// (only valid if the set of drawables hasn't changed since build;
+	//  only drawables whose world matrices changed -- because their transform or an ancestor moved -- are
+	//  recomputed, so call build() after changing a drawable's min/max)
+	void refit();
+
+	//--- queries ---
+	// (results are appended to the given vector)
+
+	//drawables whose bounds are hit by the ray origin + t * direction for t in [0, max_t]:
+	struct RayHit {
+		Scene::Drawable const *drawable;
+		float t; //where ray enters drawable's bounds (0 if origin is inside)
+	};
+	//hits are sorted by t:
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::vector< RayHit > *hits) const;
+
+	//drawables whose bounds overlap the box [min, max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Scene::Drawable const * > *results) const;
+
+	//drawables whose bounds overlap a sphere:
+	void query_sphere(glm::vec3 const &center, float radius, std::vector< Scene::Drawable const * > *results) const;
+
+	//drawables whose bounds are (possibly) inside the view frustum of world_to_clip:
+	void query_frustum(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > *results) const;
+
+	//--- internals ---
+
+	//nodes are stored parents-before-children; children of an interior node are at first, first+1:
+	struct Node {
+		glm::vec3 min = glm::vec3(0.0f);
+		uint32_t first = 0; //first child (interior) or first entry of 'items' (leaf)
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t count = 0; //number of items (leaf), or 0 for interior nodes
+	};
+	static_assert(sizeof(Node) == 32, "Node is packed.");
+	std::vector< Node > nodes;
+
+	//leaves index into 'items':
+	struct Item {
+		Scene::Drawable const *drawable = nullptr;
+		glm::vec3 min = glm::vec3(0.0f); //world-space bounds
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t generation = 0; //drawable's transform's world_cache.generation when bounds were computed
+	};
+	std::vector< Item > items;
+
+	//leaves hold at most this many items, except at MaxDepth, where the tree stops splitting:
+	// (median splits reach MaxDepth only past 2^MaxDepth items; the cap bounds traverse()'s fixed-size stack)
+	enum : uint32_t { MaxLeafItems = 4, MaxDepth = 48 };
+
+	//scene and its drawables.version at build time, used by update() to detect changes:
+	Scene const *built_scene = nullptr;
+	uint32_t built_version = 0;
+
+	//helpers:
+	static void compute_bounds(Item *item); //(item's drawable's transform's world cache must be up to date)
+	void build_node(uint32_t node, uint32_t begin, uint32_t end, uint32_t depth); //build nodes[node] (at 'depth') over items[begin,end)
+	void refit_nodes();
+	template< typename Overlaps, typename Visit >
+	void traverse(Overlaps const &overlaps, Visit const &visit) const;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+/*
+ * A Handle refers to an element of a slot-based store (TransformStore, ComponentStore)
+ *  independent of the element's current array index.
+ *
+ * Each slot has a generation that is incremented when its element is removed,
+ *  so a handle to a removed element is detected as invalid even once the slot is reused.
+ *
+ */
+
+#include <cstdint>
+
+struct Handle {
+	Handle() : slot(-1U), generation(0) { } //default handle refers to nothing
+	Handle(uint32_t slot_, uint32_t generation_) : slot(slot_), generation(generation_) { }
+	uint32_t slot;
+	uint32_t generation;
+	bool operator==(Handle const &o) const { return slot == o.slot && generation == o.generation; }
+	bool operator!=(Handle const &o) const { return !(*this == o); }
+};
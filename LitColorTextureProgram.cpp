@@ -11,17 +11,13 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//per-object matrices come from the scene's object buffer:
+	lit_color_texture_program_pipeline.OBJECT_INDEX_int = ret->OBJECT_INDEX_int;
+	lit_color_texture_program_pipeline.WORLD_TO_CLIP_mat4 = ret->WORLD_TO_CLIP_mat4;
+	lit_color_texture_program_pipeline.WORLD_TO_LIGHT_mat4x3 = ret->WORLD_TO_LIGHT_mat4x3;
+	lit_color_texture_program_pipeline.WORLD_NORMAL_TO_LIGHT_mat3 = ret->WORLD_NORMAL_TO_LIGHT_mat3;
+
+	//(lights come from the scene's light buffer, with per-object light lists in the object buffer)
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -43,14 +39,62 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > instanced_lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	//----- add instanced version to the pipeline template -----
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+
+	lit_color_texture_program_pipeline.instanced.WORLD_TO_CLIP_mat4 = ret->WORLD_TO_CLIP_mat4;
+	lit_color_texture_program_pipeline.instanced.WORLD_TO_LIGHT_mat4x3 = ret->WORLD_TO_LIGHT_mat4x3;
+	lit_color_texture_program_pipeline.instanced.WORLD_NORMAL_TO_LIGHT_mat3 = ret->WORLD_NORMAL_TO_LIGHT_mat3;
+	lit_color_texture_program_pipeline.instanced.LIGHT_INDICES_vec4 = ret->LIGHT_INDICES_vec4;
+
+	//per-instance data buffer (filled by Scene::draw):
+	glGenBuffers(1, &lit_color_texture_program_pipeline.instanced.instance_buffer);
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
+		(instanced ?
+		"#version 330\n"
+		"uniform mat4 WORLD_TO_CLIP;\n"
+		"uniform mat4x3 WORLD_TO_LIGHT;\n"
+		"uniform mat3 WORLD_NORMAL_TO_LIGHT;\n"
+		"uniform vec4 LIGHT_INDICES[2];\n" //per-batch light list
+		"in mat4x3 OBJECT_TO_WORLD;\n" //per-instance
+		"in mat3 NORMAL_TO_WORLD;\n" //per-instance
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in vec2 TexCoord;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"flat out vec4 lightIndices0;\n"
+		"flat out vec4 lightIndices1;\n"
+		"void main() {\n"
+		"	vec4 world_position = vec4(OBJECT_TO_WORLD * Position, 1.0);\n"
+		"	gl_Position = WORLD_TO_CLIP * world_position;\n"
+		"	position = WORLD_TO_LIGHT * world_position;\n"
+		"	normal = WORLD_NORMAL_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
+		"	lightIndices0 = LIGHT_INDICES[0];\n"
+		"	lightIndices1 = LIGHT_INDICES[1];\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+		:
 		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		"uniform mat4 WORLD_TO_CLIP;\n"
+		"uniform mat4x3 WORLD_TO_LIGHT;\n"
+		"uniform mat3 WORLD_NORMAL_TO_LIGHT;\n"
+		"uniform samplerBuffer OBJECTS;\n" //eight texels per object; see Scene::ObjectData
+		"uniform int OBJECT_INDEX;\n"
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -59,48 +103,72 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"flat out vec4 lightIndices0;\n"
+		"flat out vec4 lightIndices1;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	int base = 8 * OBJECT_INDEX;\n"
+		"	vec4 world_position = vec4(\n"
+		"		dot(texelFetch(OBJECTS, base+0), Position),\n"
+		"		dot(texelFetch(OBJECTS, base+1), Position),\n"
+		"		dot(texelFetch(OBJECTS, base+2), Position),\n"
+		"		1.0\n"
+		"	);\n"
+		"	vec3 world_normal = vec3(\n"
+		"		dot(texelFetch(OBJECTS, base+3).xyz, Normal),\n"
+		"		dot(texelFetch(OBJECTS, base+4).xyz, Normal),\n"
+		"		dot(texelFetch(OBJECTS, base+5).xyz, Normal)\n"
+		"	);\n"
+		"	gl_Position = WORLD_TO_CLIP * world_position;\n"
+		"	position = WORLD_TO_LIGHT * world_position;\n"
+		"	normal = WORLD_NORMAL_TO_LIGHT * world_normal;\n"
+		"	lightIndices0 = texelFetch(OBJECTS, base+6);\n"
+		"	lightIndices1 = texelFetch(OBJECTS, base+7);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
+		)
 	,
 		//fragment shader:
 		"#version 330\n"
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		"uniform samplerBuffer LIGHTS;\n" //three texels per light; see Scene::LightData
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
+		"flat in vec4 lightIndices0;\n" //indices into LIGHTS, padded with -1
+		"flat in vec4 lightIndices1;\n"
 		"out vec4 fragColor;\n"
 		"void main() {\n"
 		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	for (int i = 0; i < 8; ++i) {\n" //(8 == Scene::MaxObjectLights)
+		"		float index = (i < 4 ? lightIndices0[i] : lightIndices1[i-4]);\n"
+		"		if (index < 0.0) break; //lists are packed, so the first -1 ends the list \n"
+		"		vec4 position_type = texelFetch(LIGHTS, 3 * int(index) + 0);\n"
+		"		vec4 direction_cutoff = texelFetch(LIGHTS, 3 * int(index) + 1);\n"
+		"		vec3 energy = texelFetch(LIGHTS, 3 * int(index) + 2).rgb;\n"
+		"		int type = int(position_type.w);\n"
+		"		vec3 direction = direction_cutoff.xyz;\n"
+		"		if (type == 0) { //point light \n"
+		"			vec3 l = (position_type.xyz - position);\n"
+		"			float dis2 = dot(l,l);\n"
+		"			l = normalize(l);\n"
+		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"			e += nl * energy;\n"
+		"		} else if (type == 1) { //hemi light \n"
+		"			e += (dot(n,-direction) * 0.5 + 0.5) * energy;\n"
+		"		} else if (type == 2) { //spot light \n"
+		"			vec3 l = (position_type.xyz - position);\n"
+		"			float dis2 = dot(l,l);\n"
+		"			l = normalize(l);\n"
+		"			float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"			float c = dot(l,-direction);\n"
+		"			nl *= smoothstep(direction_cutoff.w,mix(direction_cutoff.w,1.0,0.1), c);\n"
+		"			e += nl * energy;\n"
+		"		} else { //(type == 3) //directional light \n"
+		"			e += max(0.0, dot(n,-direction)) * energy;\n"
+		"		}\n"
 		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
@@ -116,23 +184,24 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
 	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+	WORLD_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "WORLD_TO_LIGHT");
+	WORLD_NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "WORLD_NORMAL_TO_LIGHT");
+	OBJECT_INDEX_int = glGetUniformLocation(program, "OBJECT_INDEX");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	LIGHT_INDICES_vec4 = glGetUniformLocation(program, "LIGHT_INDICES");
 
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint OBJECTS_samplerBuffer = glGetUniformLocation(program, "OBJECTS");
+	GLuint LIGHTS_samplerBuffer = glGetUniformLocation(program, "LIGHTS");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	if (OBJECTS_samplerBuffer != -1U) glUniform1i(OBJECTS_samplerBuffer, Scene::ObjectBufferUnit); //object buffer is bound here by Scene::draw
+	glUniform1i(LIGHTS_samplerBuffer, Scene::LightBufferUnit); //light buffer is bound here by Scene::draw
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
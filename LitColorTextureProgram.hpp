@@ -5,8 +5,10 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// (per-object matrices are read from the scene's object buffer -- see Scene::ObjectData --
+//  or, in the 'instanced' variant, from per-instance attributes -- see MeshInstance)
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -18,23 +20,25 @@ struct LitColorTextureProgram {
 	GLuint TexCoord_vec2 = -1U;
 
 	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint WORLD_TO_CLIP_mat4 = -1U;
+	GLuint WORLD_TO_LIGHT_mat4x3 = -1U;
+	GLuint WORLD_NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint OBJECT_INDEX_int = -1U; //(not in instanced variant)
 
 	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	// (lights are read from the scene's light buffer -- see Scene::LightData -- using a per-object light list)
+	GLuint LIGHT_INDICES_vec4 = -1U; //(instanced variant only) per-batch light list
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//Scene::ObjectBufferUnit - per-object data (non-instanced variant)
+	//Scene::LightBufferUnit - light data
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > instanced_lit_color_texture_program;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: pipeline.instanced is set up too, except for 'vao' -- make one with MeshBuffer::make_vao_for_program(instanced_lit_color_texture_program->program, lit_color_texture_program_pipeline.instanced.instance_buffer)
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
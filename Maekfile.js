@@ -121,14 +121,24 @@ if (maek.OS === 'windows') {
 // cppFile: name of c++ file to compile
 // objFileBase (optional): base name object file to produce (if not supplied, set to options.objDir + '/' + cppFile without the extension)
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
+//(also used by sound-latency)
+const sound_names = [
+	maek.CPP('Sound.cpp'),
+	maek.CPP('load_wav.cpp'),
+	maek.CPP('load_opus.cpp')
+];
+
 const game_names = [
 	maek.CPP('PlayMode.cpp'),
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
-	maek.CPP('Sound.cpp'),
-	maek.CPP('load_wav.cpp'),
-	maek.CPP('load_opus.cpp')
+	...sound_names
+];
+
+//(also used by convert-scene and split-world, which don't need the rest of common_names)
+const mapped_file_names = [
+	maek.CPP('MappedFile.cpp')
 ];
 
 const common_names = [
@@ -138,7 +148,14 @@ const common_names = [
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('TransformStore.cpp'),
+	maek.CPP('WorkerPool.cpp'),
+	maek.CPP('DrawableBVH.cpp'),
+	maek.CPP('OcclusionBuffer.cpp'),
+	maek.CPP('Animation.cpp'),
+	maek.CPP('WorldStream.cpp'),
 	maek.CPP('Mesh.cpp'),
+	...mapped_file_names,
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
 	maek.CPP('Mode.cpp'),
@@ -158,6 +175,52 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const convert_scene_names = [
+	maek.CPP('convert-scene.cpp')
+];
+
+const split_world_names = [
+	maek.CPP('split-world.cpp')
+];
+
+//streams a synthetic world (see WorldStream.hpp), as split-world's output would be streamed:
+const world_stream_test_names = [
+	maek.CPP('world-stream-test.cpp')
+];
+
+//tests and benchmarks (not part of the default targets):
+const sound_latency_names = [
+	maek.CPP('sound-latency.cpp')
+];
+
+const world_update_bench_names = [
+	maek.CPP('world-update-bench.cpp')
+];
+
+const bvh_bench_names = [
+	maek.CPP('bvh-bench.cpp')
+];
+
+const occlusion_bench_names = [
+	maek.CPP('occlusion-bench.cpp')
+];
+
+const animation_test_names = [
+	maek.CPP('animation-test.cpp')
+];
+
+const local_matrix_bench_names = [
+	maek.CPP('local-matrix-bench.cpp')
+];
+
+const spawn_bench_names = [
+	maek.CPP('spawn-bench.cpp')
+];
+
+const component_bench_names = [
+	maek.CPP('component-bench.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
@@ -165,9 +228,20 @@ const show_scene_names = [
 const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const convert_scene_exe = maek.LINK([...convert_scene_names, ...mapped_file_names], 'scenes/convert-scene');
+const split_world_exe = maek.LINK([...split_world_names, ...mapped_file_names], 'scenes/split-world');
+const world_stream_test_exe = maek.LINK([...world_stream_test_names, ...common_names], 'bench/world-stream-test');
+const sound_latency_exe = maek.LINK([...sound_latency_names, ...sound_names], 'bench/sound-latency');
+const world_update_bench_exe = maek.LINK([...world_update_bench_names, ...common_names], 'bench/world-update-bench');
+const bvh_bench_exe = maek.LINK([...bvh_bench_names, ...common_names], 'bench/bvh-bench');
+const occlusion_bench_exe = maek.LINK([...occlusion_bench_names, ...common_names], 'bench/occlusion-bench');
+const animation_test_exe = maek.LINK([...animation_test_names, ...common_names], 'bench/animation-test');
+const local_matrix_bench_exe = maek.LINK([...local_matrix_bench_names, ...common_names], 'bench/local-matrix-bench');
+const spawn_bench_exe = maek.LINK([...spawn_bench_names, ...common_names], 'bench/spawn-bench');
+const component_bench_exe = maek.LINK([...component_bench_names, ...common_names], 'bench/component-bench');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, convert_scene_exe, split_world_exe, ...copies];
 
 //the '[targets =] RULE(targets, prerequisites[, recipe])' rule defines a Makefile-style task
 // targets: array of targets the task produces (can include both files and ':abstract targets')
@@ -178,6 +252,19 @@ maek.RULE([':run'], [game_exe], [
 	[game_exe, '--some-command-line-option']
 ]);
 
+//build and run the tests and benchmarks:
+maek.RULE([':bench'], [sound_latency_exe, world_update_bench_exe, bvh_bench_exe, occlusion_bench_exe, animation_test_exe, local_matrix_bench_exe, spawn_bench_exe, component_bench_exe, world_stream_test_exe], [
+	[sound_latency_exe],
+	[world_update_bench_exe],
+	[bvh_bench_exe],
+	[occlusion_bench_exe],
+	[animation_test_exe],
+	[local_matrix_bench_exe],
+	[spawn_bench_exe],
+	[component_bench_exe],
+	[world_stream_test_exe]
+]);
+
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
 
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file read-only into memory, so it can be parsed
+ *  in place (e.g., with ChunkReader from read_write_chunk.hpp) rather than
+ *  copied through a stream.
+ *
+ */
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct MappedFile {
+	//map a file:
+	// note: will throw if the file can't be opened or mapped.
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//mappings own OS resources, so they are not copyable:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *begin() const { return data; }
+	char const *end() const { return data + size; }
+
+	char const *data = nullptr; //mapped contents (nullptr for empty files)
+	size_t size = 0; //size of the mapping, in bytes
+
+	//--- internals ---
+	void *handle = nullptr; //(windows only) file mapping object
+};
@@ -1,10 +1,10 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -14,7 +14,9 @@
 MeshBuffer::MeshBuffer(std::string const &filename) {
 	glGenBuffers(1, &buffer);
 
-	std::ifstream file(filename, std::ios::binary);
+	//file is parsed in place; vertex data goes straight from the mapping to OpenGL:
+	MappedFile file(filename);
+	ChunkReader reader(file.begin(), file.end());
 
 	GLuint total = 0;
 
@@ -25,11 +27,11 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	ChunkSpan< Vertex > data;
 
 	//read + upload data chunk:
 	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+		data = reader.read< Vertex >("pnct");
 
 		//upload data:
 		glBindBuffer(GL_ARRAY_BUFFER, buffer);
@@ -47,8 +49,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	ChunkSpan< char > strings = reader.read< char >("str0");
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
@@ -57,8 +58,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkSpan< IndexEntry > index = reader.read< IndexEntry >("idx0");
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -67,7 +67,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
@@ -83,7 +83,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (!reader.at_end()) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
@@ -106,7 +106,7 @@ const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint instance_buffer) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -128,6 +128,25 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//Try to bind per-instance matrix attributes (one location per matrix column):
+	if (instance_buffer != 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		auto bind_instance_matrix = [&](char const *name, GLint rows, GLuint columns, GLsizei offset) {
+			GLint location = glGetAttribLocation(program, name);
+			if (location == -1) return; //can't bind missing attribs
+			for (GLuint c = 0; c < columns; ++c) {
+				GLuint column_location = GLuint(location) + c;
+				glVertexAttribPointer(column_location, rows, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (GLbyte *)0 + offset + c * rows * sizeof(float));
+				glVertexAttribDivisor(column_location, 1);
+				glEnableVertexAttribArray(column_location);
+			}
+			bound.insert(GLuint(location));
+		};
+		bind_instance_matrix("OBJECT_TO_WORLD", 3, 4, offsetof(MeshInstance, object_to_world));
+		bind_instance_matrix("NORMAL_TO_WORLD", 3, 3, offsetof(MeshInstance, normal_to_world));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
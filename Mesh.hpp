@@ -29,6 +29,14 @@ struct Mesh {
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
 };
 
+//Per-instance attribute data for instanced drawing, as read through the vaos made by
+// MeshBuffer::make_vao_for_program with an instance buffer (Scene::draw fills such buffers):
+struct MeshInstance {
+	glm::mat4x3 object_to_world;
+	glm::mat3 normal_to_world;
+};
+static_assert(sizeof(MeshInstance) == 4*3*4 + 3*3*4, "MeshInstance is packed.");
+
 struct MeshBuffer {
 	//construct from a file:
 	// note: will throw if file fails to read.
@@ -40,7 +48,9 @@ struct MeshBuffer {
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
-	GLuint make_vao_for_program(GLuint program) const;
+	//if instance_buffer is non-zero, also links per-instance 'OBJECT_TO_WORLD' (mat4x3) and
+	// 'NORMAL_TO_WORLD' (mat3) attributes to that buffer, laid out as MeshInstance structures:
+	GLuint make_vao_for_program(GLuint program, GLuint instance_buffer = 0) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
@@ -0,0 +1,298 @@
+#include "OcclusionBuffer.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+//boxes must be this much (relatively) farther than an occluder to be hidden by it,
+// so that occluders built from a drawable's own bounds don't hide that drawable:
+static constexpr float DepthBias = 1.0e-3f;
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width_, uint32_t height_) : width((width_ + 3) & ~3u), height(height_) {
+	assert(width > 0 && height > 0);
+	static_assert(TileWidth % 4 == 0, "tiles hold whole four-pixel groups");
+	tiles_x = (width + TileWidth - 1) / TileWidth;
+	tiles_y = (height + TileHeight - 1) / TileHeight;
+	depth.assign(width * height, 0.0f);
+	tile_farthest.assign(tiles_x * tiles_y, 0.0f);
+	bins.resize(tiles_x * tiles_y);
+}
+
+OcclusionBuffer::Occluder OcclusionBuffer::make_box(Scene::Transform const *transform, glm::vec3 const &min, glm::vec3 const &max) {
+	Occluder ret(transform);
+	auto corner = [&](uint32_t c) {
+		return glm::vec3((c & 1 ? max.x : min.x), (c & 2 ? max.y : min.y), (c & 4 ? max.z : min.z));
+	};
+	//two triangles per face, as corner indices:
+	static uint8_t const faces[6][4] = {
+		{0,2,6,4}, {1,5,7,3}, //-x, +x
+		{0,4,5,1}, {2,3,7,6}, //-y, +y
+		{0,1,3,2}, {4,6,7,5}, //-z, +z
+	};
+	static uint8_t const fan[6] = {0,1,2, 0,2,3};
+	ret.triangles.reserve(6 * 6);
+	for (auto const &f : faces) {
+		for (uint8_t i : fan) {
+			ret.triangles.emplace_back(corner(f[i]));
+		}
+	}
+	return ret;
+}
+
+void OcclusionBuffer::render(glm::mat4 const &world_to_clip_, std::vector< Occluder > const &occluders, WorkerPool *pool) {
+	world_to_clip = world_to_clip_;
+	triangles_rasterized = 0;
+	tile_triangles = 0;
+
+	//transform and clip occluders to screen-space triangles:
+	// (serially, since world matrices are cached on transforms)
+	triangles.clear();
+	for (auto const &occluder : occluders) {
+		assert(occluder.triangles.size() % 3 == 0);
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(occluder.transform->make_local_to_world());
+		for (size_t i = 0; i + 2 < occluder.triangles.size(); i += 3) {
+			add_triangle(
+				object_to_clip * glm::vec4(occluder.triangles[i+0], 1.0f),
+				object_to_clip * glm::vec4(occluder.triangles[i+1], 1.0f),
+				object_to_clip * glm::vec4(occluder.triangles[i+2], 1.0f)
+			);
+		}
+	}
+	triangles_rasterized = uint32_t(triangles.size());
+
+	//bin triangles to the tiles they touch:
+	for (auto &bin : bins) {
+		bin.clear();
+	}
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		ScreenTriangle const &tri = triangles[t];
+		for (uint32_t ty = tri.min.y / TileHeight; ty <= uint32_t(tri.max.y) / TileHeight; ++ty) {
+			for (uint32_t tx = tri.min.x / TileWidth; tx <= uint32_t(tri.max.x) / TileWidth; ++tx) {
+				bins[ty * tiles_x + tx].emplace_back(t);
+				tile_triangles += 1;
+			}
+		}
+	}
+
+	//rasterize tiles (each tile only writes its own pixels, so tiles can run in parallel):
+	uint32_t tile_count = tiles_x * tiles_y;
+	if (pool) {
+		pool->parallel_for(tile_count, 1, [this](uint32_t begin, uint32_t end) {
+			for (uint32_t tile = begin; tile < end; ++tile) {
+				rasterize_tile(tile);
+			}
+		});
+	} else {
+		for (uint32_t tile = 0; tile < tile_count; ++tile) {
+			rasterize_tile(tile);
+		}
+	}
+}
+
+void OcclusionBuffer::add_triangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c) {
+	//clip against the near plane ( z >= -w ), which leaves at most four vertices:
+	glm::vec4 const in[3] = {a, b, c};
+	glm::vec4 out[4];
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < 3; ++i) {
+		glm::vec4 const &cur = in[i];
+		glm::vec4 const &next = in[(i + 1) % 3];
+		float d_cur = cur.z + cur.w;
+		float d_next = next.z + next.w;
+		if (d_cur >= 0.0f) out[count++] = cur;
+		if ((d_cur >= 0.0f) != (d_next >= 0.0f)) {
+			out[count++] = cur + (d_cur / (d_cur - d_next)) * (next - cur);
+		}
+	}
+	for (uint32_t i = 2; i < count; ++i) {
+		add_screen_triangle(out[0], out[i-1], out[i]);
+	}
+}
+
+void OcclusionBuffer::add_screen_triangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c) {
+	glm::vec4 const clip[3] = {a, b, c};
+	ScreenTriangle tri;
+	float d[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		if (!(clip[i].w > 0.0f)) return; //(degenerate; only possible for points on the near plane with w == 0)
+		d[i] = 1.0f / clip[i].w;
+		tri.v[i] = glm::vec2(
+			(clip[i].x * d[i] * 0.5f + 0.5f) * float(width),
+			(clip[i].y * d[i] * 0.5f + 0.5f) * float(height)
+		);
+	}
+
+	float area = (tri.v[1].x - tri.v[0].x) * (tri.v[2].y - tri.v[0].y) - (tri.v[2].x - tri.v[0].x) * (tri.v[1].y - tri.v[0].y);
+	if (!(std::abs(area) > 1.0e-6f)) return;
+	if (area < 0.0f) {
+		std::swap(tri.v[1], tri.v[2]);
+		std::swap(d[1], d[2]);
+		area = -area;
+	}
+
+	//pixels whose centers (x + 0.5, y + 0.5) fall in the triangle's bounding box:
+	glm::vec2 lo = glm::min(tri.v[0], glm::min(tri.v[1], tri.v[2]));
+	glm::vec2 hi = glm::max(tri.v[0], glm::max(tri.v[1], tri.v[2]));
+	if (hi.x < 0.5f || hi.y < 0.5f || lo.x > float(width) - 0.5f || lo.y > float(height) - 0.5f) return;
+	tri.min = glm::ivec2(
+		std::max(0, int32_t(std::ceil(lo.x - 0.5f))),
+		std::max(0, int32_t(std::ceil(lo.y - 0.5f)))
+	);
+	tri.max = glm::ivec2(
+		std::min(int32_t(width) - 1, int32_t(std::floor(hi.x - 0.5f))),
+		std::min(int32_t(height) - 1, int32_t(std::floor(hi.y - 0.5f)))
+	);
+	if (tri.min.x > tri.max.x || tri.min.y > tri.max.y) return;
+
+	//depth plane through the three vertices:
+	glm::vec2 e1 = tri.v[1] - tri.v[0];
+	glm::vec2 e2 = tri.v[2] - tri.v[0];
+	tri.z.x = ((d[1] - d[0]) * e2.y - (d[2] - d[0]) * e1.y) / area;
+	tri.z.y = ((d[2] - d[0]) * e1.x - (d[1] - d[0]) * e2.x) / area;
+	tri.z.z = d[0] - tri.z.x * tri.v[0].x - tri.z.y * tri.v[0].y;
+
+	triangles.emplace_back(tri);
+}
+
+void OcclusionBuffer::rasterize_tile(uint32_t tile) {
+	int32_t tx0 = int32_t((tile % tiles_x) * TileWidth);
+	int32_t ty0 = int32_t((tile / tiles_x) * TileHeight);
+	int32_t tx1 = std::min(int32_t(width), tx0 + int32_t(TileWidth)) - 1;
+	int32_t ty1 = std::min(int32_t(height), ty0 + int32_t(TileHeight)) - 1;
+
+	for (int32_t y = ty0; y <= ty1; ++y) {
+		std::fill(&depth[y * width + tx0], &depth[y * width + tx1] + 1, 0.0f);
+	}
+
+	for (uint32_t t : bins[tile]) {
+		ScreenTriangle const &tri = triangles[t];
+
+		//edge functions (A * x + B * y + C >= 0 inside a counter-clockwise triangle):
+		float A[3], B[3], C[3];
+		for (uint32_t i = 0; i < 3; ++i) {
+			glm::vec2 const &p = tri.v[i];
+			glm::vec2 const &q = tri.v[(i + 1) % 3];
+			A[i] = -(q.y - p.y);
+			B[i] = q.x - p.x;
+			C[i] = -(A[i] * p.x + B[i] * p.y);
+		}
+
+		//pixel range within this tile, starting at a four-pixel group:
+		// (groups never leave the tile, since tiles start and end on group boundaries)
+		int32_t x_begin = std::max(tri.min.x, tx0) & ~3;
+		int32_t x_last = std::min(tri.max.x, tx1);
+		int32_t y_begin = std::max(tri.min.y, ty0);
+		int32_t y_last = std::min(tri.max.y, ty1);
+
+		for (int32_t y = y_begin; y <= y_last; ++y) {
+			float py = float(y) + 0.5f;
+			float *row = &depth[y * width];
+			float row_e[3];
+			for (uint32_t i = 0; i < 3; ++i) {
+				row_e[i] = B[i] * py + C[i];
+			}
+			float row_z = tri.z.y * py + tri.z.z;
+#ifdef SIMD_SSE2
+			__m128 const offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 const zero = _mm_setzero_ps();
+			for (int32_t x = x_begin; x <= x_last; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), offsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), px), _mm_set1_ps(row_e[0])), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), px), _mm_set1_ps(row_e[1])), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), px), _mm_set1_ps(row_e[2])), zero));
+				__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.z.x), px), _mm_set1_ps(row_z));
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_max_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+#else
+			for (int32_t x = x_begin; x <= x_last; x += 4) {
+				for (int32_t l = 0; l < 4; ++l) {
+					float px = float(x + l) + 0.5f;
+					if (A[0] * px + row_e[0] >= 0.0f && A[1] * px + row_e[1] >= 0.0f && A[2] * px + row_e[2] >= 0.0f) {
+						row[x + l] = std::max(row[x + l], tri.z.x * px + row_z);
+					}
+				}
+			}
+#endif
+		}
+	}
+
+	//record the farthest depth in the tile:
+	float farthest = std::numeric_limits< float >::infinity();
+	for (int32_t y = ty0; y <= ty1; ++y) {
+		float const *row = &depth[y * width];
+		for (int32_t x = tx0; x <= tx1; ++x) {
+			farthest = std::min(farthest, row[x]);
+		}
+	}
+	tile_farthest[tile] = farthest;
+}
+
+bool OcclusionBuffer::occluded(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const {
+	//screen-space bounds and nearest depth of the box's corners:
+	glm::vec2 lo = glm::vec2( std::numeric_limits< float >::infinity());
+	glm::vec2 hi = glm::vec2(-std::numeric_limits< float >::infinity());
+	float nearest = 0.0f;
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec4 corner = object_to_clip * glm::vec4(
+			(c & 1 ? max.x : min.x),
+			(c & 2 ? max.y : min.y),
+			(c & 4 ? max.z : min.z),
+			1.0f
+		);
+		if (!(corner.w > 0.0f) || corner.z < -corner.w) return false; //crosses the near plane
+		float inv_w = 1.0f / corner.w;
+		glm::vec2 at = glm::vec2(
+			(corner.x * inv_w * 0.5f + 0.5f) * float(width),
+			(corner.y * inv_w * 0.5f + 0.5f) * float(height)
+		);
+		lo = glm::min(lo, at);
+		hi = glm::max(hi, at);
+		nearest = std::max(nearest, inv_w);
+	}
+	if (hi.x < 0.0f || hi.y < 0.0f || lo.x > float(width) || lo.y > float(height)) return false; //(frustum culling's job)
+
+	//every pixel the bounds touch (only the on-screen part can be seen):
+	int32_t x0 = glm::clamp(int32_t(std::floor(lo.x)), 0, int32_t(width) - 1);
+	int32_t y0 = glm::clamp(int32_t(std::floor(lo.y)), 0, int32_t(height) - 1);
+	int32_t x1 = glm::clamp(int32_t(std::floor(hi.x)), 0, int32_t(width) - 1);
+	int32_t y1 = glm::clamp(int32_t(std::floor(hi.y)), 0, int32_t(height) - 1);
+
+	//the box is hidden if every one of those pixels holds something nearer than 'threshold':
+	float threshold = nearest * (1.0f + DepthBias);
+
+	//quick accept: every touched tile is entirely nearer:
+	bool tiles_hide = true;
+	for (int32_t ty = y0 / int32_t(TileHeight); tiles_hide && ty <= y1 / int32_t(TileHeight); ++ty) {
+		for (int32_t tx = x0 / int32_t(TileWidth); tx <= x1 / int32_t(TileWidth); ++tx) {
+			if (!(tile_farthest[ty * tiles_x + tx] > threshold)) {
+				tiles_hide = false;
+				break;
+			}
+		}
+	}
+	if (tiles_hide) return true;
+
+	//otherwise check pixel-by-pixel, stopping at the first one the box might show through:
+	for (int32_t y = y0; y <= y1; ++y) {
+		float const *row = &depth[y * width];
+		int32_t x = x0;
+		for (; x <= x1 && (x & 3); ++x) {
+			if (!(row[x] > threshold)) return false;
+		}
+#ifdef SIMD_SSE2
+		__m128 const limit = _mm_set1_ps(threshold);
+		for (; x + 3 <= x1; x += 4) {
+			if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), limit)) != 0) return false;
+		}
+#endif
+		for (; x <= x1; ++x) {
+			if (!(row[x] > threshold)) return false;
+		}
+	}
+	return true;
+}
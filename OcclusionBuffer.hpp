@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * OcclusionBuffer is a small, CPU-side depth buffer used to skip drawables
+ *  that are hidden behind other geometry.
+ *
+ * Each frame, render() rasterizes a handful of large, simple "occluder" meshes
+ *  (walls, floors, buildings -- usually low-poly stand-ins that fit inside the
+ *  meshes that are actually drawn) into it; occluded() then reports whether a
+ *  box is entirely behind them.
+ * Point Scene::occlusion at a rendered buffer to have Scene::draw skip hidden drawables.
+ *
+ * Depth is stored as 1/w (larger is nearer; 0 means "nothing here"),
+ *  since 1/w varies linearly across the screen.
+ * The screen is split into tiles, which render() rasterizes in parallel if given a WorkerPool;
+ *  inner loops work on four pixels at a time (with SSE where available).
+ *
+ * Occluders cover the pixels whose centers they cover, so at low resolutions
+ *  objects peeking less than a pixel past an occluder's silhouette may be culled.
+ *
+ */
+
+#include "Scene.hpp"
+#include "WorkerPool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct OcclusionBuffer {
+	//width is rounded up to a multiple of four:
+	OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+	struct Occluder {
+		Occluder(Scene::Transform const *transform_) : transform(transform_) { assert(transform); }
+		Scene::Transform const *transform;
+		//local-space vertices, three per triangle (winding doesn't matter):
+		std::vector< glm::vec3 > triangles;
+	};
+	//helper: occluder for the box [min,max] (e.g., a drawable whose mesh fills its bounds):
+	static Occluder make_box(Scene::Transform const *transform, glm::vec3 const &min, glm::vec3 const &max);
+
+	//clear the buffer and rasterize occluders as seen through world_to_clip:
+	void render(glm::mat4 const &world_to_clip, std::vector< Occluder > const &occluders, WorkerPool *pool = nullptr);
+
+	//is the box [min,max] (under object_to_clip) entirely hidden behind the occluders?
+	// (conservative: boxes that cross the near plane are never occluded)
+	bool occluded(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const;
+
+	//counts from the most recent render() call:
+	uint32_t triangles_rasterized = 0; //after near-plane clipping
+	uint32_t tile_triangles = 0; //sum over tiles of triangles binned to that tile
+
+	//--- internals ---
+	uint32_t width, height;
+	glm::mat4 world_to_clip = glm::mat4(1.0f); //as passed to the last render()
+
+	std::vector< float > depth; //width * height, row-major, row 0 at the bottom of the screen
+
+	//tiles are rasterized independently; widths are multiples of four so four-pixel groups never straddle tiles:
+	enum : uint32_t { TileWidth = 64, TileHeight = 32 };
+	uint32_t tiles_x, tiles_y;
+	std::vector< float > tile_farthest; //smallest depth in each tile, for quick rejection in occluded()
+
+	//triangles in screen space (pixel units), ready to rasterize:
+	struct ScreenTriangle {
+		glm::vec2 v[3]; //counter-clockwise
+		glm::vec3 z; //depth = z.x * x + z.y * y + z.z
+		glm::ivec2 min, max; //pixel bounds (inclusive)
+	};
+	std::vector< ScreenTriangle > triangles;
+	std::vector< std::vector< uint32_t > > bins; //triangles touching each tile
+
+	//helpers:
+	void add_triangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c); //clip-space; clips to near plane
+	void add_screen_triangle(glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c); //clip-space; in front of near plane
+	void rasterize_tile(uint32_t tile);
+};
@@ -15,9 +15,11 @@
 // ---------------------- Load Functions ----------------
 
 GLuint heart_meshes_for_lit_color_texture_program = 0;
+GLuint heart_meshes_for_instanced_lit_color_texture_program = 0;
 Load< MeshBuffer > heart_meshes(LoadTagDefault, []() -> MeshBuffer const * {
 	MeshBuffer const *ret = new MeshBuffer(data_path("HeartbeatSurvival.pnct"));
 	heart_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	heart_meshes_for_instanced_lit_color_texture_program = ret->make_vao_for_program(instanced_lit_color_texture_program->program, lit_color_texture_program_pipeline.instanced.instance_buffer);
 	return ret;
 });
 
@@ -27,13 +29,18 @@ Load< Scene > main_scene(LoadTagDefault, []() -> Scene const * {
 
 		scene.drawables.emplace_back(transform);
 		Scene::Drawable &drawable = scene.drawables.back();
+		Scene::Drawable::Pipeline &pipeline = scene.pipeline(drawable);
 
-		drawable.pipeline = lit_color_texture_program_pipeline;
+		pipeline = lit_color_texture_program_pipeline;
 
-		drawable.pipeline.vao = heart_meshes_for_lit_color_texture_program;
-		drawable.pipeline.type = mesh.type;
-		drawable.pipeline.start = mesh.start;
-		drawable.pipeline.count = mesh.count;
+		pipeline.vao = heart_meshes_for_lit_color_texture_program;
+		pipeline.instanced.vao = heart_meshes_for_instanced_lit_color_texture_program;
+		pipeline.type = mesh.type;
+		pipeline.start = mesh.start;
+		pipeline.count = mesh.count;
+
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
 	});
 });
 
@@ -57,11 +64,9 @@ Load< Sound::Sample > negative_sfx_sample(LoadTagDefault, []() -> Sound::Sample
 
 PlayMode::PlayMode() : scene(*main_scene) {
 	// Get pointers to hearts
-	for (auto &transform : scene.transforms) {
-		if (transform.name == "good_heart") good_heart = &transform;
-		else if (transform.name == "mid_heart") mid_heart = &transform;
-		else if (transform.name == "bad_heart") bad_heart = &transform;
-	}
+	good_heart = scene.find("good_heart");
+	mid_heart = scene.find("mid_heart");
+	bad_heart = scene.find("bad_heart");
 	if (good_heart == nullptr) throw std::runtime_error("good_heart not found.");
 	if (mid_heart == nullptr) throw std::runtime_error("mid_heart not found.");
 	if (bad_heart == nullptr) throw std::runtime_error("bad_heart not found.");
@@ -73,6 +78,26 @@ PlayMode::PlayMode() : scene(*main_scene) {
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
+
+	//the ground plane is the only large, solid mesh, so it is the only occluder:
+	for (auto const &drawable : scene.drawables) {
+		if (drawable.transform->name == "Plane") {
+			occluders.emplace_back(OcclusionBuffer::make_box(drawable.transform, drawable.min, drawable.max));
+		}
+	}
+
+	//overhead hemisphere light, in addition to any lights from the scene file:
+	scene.transforms.emplace_back();
+	scene.transforms.back().name = "sky_light"; //(default rotation: light points down -z)
+	scene.lights.emplace_back(&scene.transforms.back());
+	scene.lights.back().type = Scene::Light::Hemisphere;
+	scene.lights.back().energy = glm::vec3(1.0f, 1.0f, 0.95f);
+	scene.build_name_index(); //(new transform)
+
+	//only the good heart starts out showing:
+	mid_heart->enabled = false;
+	bad_heart->enabled = false;
+	initial_state = scene.snapshot();
 	
 	setup_menu();
 }
@@ -123,6 +148,10 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			esc.pressed = true;
 			return true;
 		}
+		else if (evt.key.keysym.sym == SDLK_o) {
+			occlusion_culling = !occlusion_culling;
+			return true;
+		}
 	} 
 	else if (evt.type == SDL_KEYUP) {
 		if (evt.key.keysym.sym == SDLK_SPACE) {
@@ -369,13 +398,7 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, -1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	glUseProgram(0);
+	//(lighting comes from scene.lights; see the sky light added in the constructor)
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -384,6 +407,16 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
 
+	//bring world matrices up to date with this frame's changes (one pass, parents before children):
+	scene.update_world_caches();
+	if (occlusion_culling) {
+		//(same world_to_clip as Scene::draw(camera) computes, so draw() will use the buffer)
+		glm::mat4 world_to_clip = camera->make_projection() * glm::mat4(camera->transform->make_world_to_local());
+		occlusion_buffer.render(world_to_clip, occluders);
+		scene.occlusion = &occlusion_buffer;
+	} else {
+		scene.occlusion = nullptr;
+	}
 	scene.draw(*camera);
 
 	switch (game_state) {
@@ -643,7 +676,9 @@ void PlayMode::swap_heart(Scene::Transform* new_heart) {
 		new_heart->rotation = cur_heart->rotation;
 		new_heart->scale = cur_heart->scale;
 
-		cur_heart->position = heart_hidden_pos;
+		new_heart->enabled = true;
+
+		cur_heart->enabled = false;
 		cur_heart->scale = glm::vec3(1, 1, 1);
 
 		cur_heart = new_heart;
@@ -652,14 +687,12 @@ void PlayMode::swap_heart(Scene::Transform* new_heart) {
 
 void PlayMode::reset_heart() {
 
-	mid_heart->position = heart_hidden_pos;
-	bad_heart->position = heart_hidden_pos;
-
-	good_heart->position = heart_base_pos;
-	good_heart->scale = glm::vec3(1, 1, 1);
-	good_heart->rotation = heart_base_rotation;
+	scene.restore(initial_state);
 	
 	cur_heart = good_heart;
+	good_heart->enabled = true;
+	mid_heart->enabled = false;
+	bad_heart->enabled = false;
 }
 
 void PlayMode::initialize_player_stats(bool is_hard_mode) {
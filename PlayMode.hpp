@@ -2,6 +2,7 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
+#include "OcclusionBuffer.hpp"
 
 #include <glm/glm.hpp>
 
@@ -49,7 +50,7 @@ struct PlayMode : Mode {
 	Scene::Transform* bad_heart = nullptr;
 	glm::vec3 heart_base_pos;
 	glm::quat heart_base_rotation;
-	glm::vec3 heart_hidden_pos = glm::vec3(10, 10, 10);
+	Scene::Snapshot initial_state; //transforms at the start of a round (restored by reset_heart)
 
 	// Music + Beat Detection (all initialized in start_new_round based on difficulty)
 	float bpm; 
@@ -100,6 +101,11 @@ struct PlayMode : Mode {
 	// Camera
 	Scene::Camera *camera = nullptr;
 
+	// Occlusion culling (toggled with 'o'; off by default, since the ground plane hides little in this scene)
+	bool occlusion_culling = false;
+	OcclusionBuffer occlusion_buffer;
+	std::vector< OcclusionBuffer::Occluder > occluders; //built from the ground plane's bounds
+
 	// Grid
 	enum GridState {
 		positive, negative, prompt, neutral
@@ -2,10 +2,20 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "scene_format.hpp"
+#include "OcclusionBuffer.hpp"
+#include "TransformStore.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unordered_set>
 
 //-------------------------
 
@@ -57,20 +67,97 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
-	}
+	update_world_cache();
+	return world_cache.local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
+	update_world_cache();
+	if (!world_cache.world_to_local_valid) {
+		//composed from inverses (rather than inverting local_to_world) so zero scales give a degenerate matrix instead of NaNs:
+		// (the parent's inverse is also computed lazily, so only the changed part of the chain is recomputed)
+		if (!parent) {
+			world_cache.world_to_local = make_parent_to_local();
+		} else {
+			glm::mat4x3 parent_world_to_local = parent->make_world_to_local();
+			update_world_cache(); //(in case that refreshed the parent's cache)
+			world_cache.world_to_local = make_parent_to_local() * glm::mat4(parent_world_to_local);
+		}
+		world_cache.world_to_local_valid = true;
+	}
+	return world_cache.world_to_local;
+}
+glm::mat3 Scene::Transform::make_normal_to_world() const {
+	update_world_cache();
+	return cached_normal_to_world();
+}
+glm::mat3 const &Scene::Transform::cached_normal_to_world() const {
+	assert(world_cache.valid);
+	if (!world_cache.normal_to_world_valid) {
+		world_cache.normal_to_world = glm::inverse(glm::transpose(glm::mat3(world_cache.local_to_world)));
+		world_cache.normal_to_world_valid = true;
+	}
+	return world_cache.normal_to_world;
+}
+
+bool Scene::Transform::cached_enabled_in_hierarchy() const {
+	//(an ancestor may have been enabled or disabled, so the chain is checked as for the matrices)
+	update_world_cache();
+	return world_cache.enabled_in_hierarchy;
+}
+
+void Scene::Transform::update_world_cache() const {
+	//ancestors first, so this compares against current parent generations:
+	// (when nothing changed, that's one comparison per ancestor)
+	if (parent) parent->update_world_cache();
+	update_world_cache_from_parent();
+}
+
+void Scene::Transform::update_world_cache(uint32_t check) const {
+	if (world_cache.check == check) return;
+	if (parent) parent->update_world_cache(check);
+	update_world_cache_from_parent();
+	world_cache.check = check;
+}
+
+void Scene::Transform::update_world_cache_from_parent() const {
+	assert((!parent || parent->world_cache.valid) && "parent's world cache has been computed");
+	if (!world_cache_dirty()) return;
+
 	if (!parent) {
-		return make_parent_to_local();
+		set_world_cache(make_local_to_parent());
 	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		//note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		set_world_cache(parent->world_cache.local_to_world * glm::mat4(make_local_to_parent()));
 	}
 }
 
+bool Scene::Transform::world_cache_dirty() const {
+	//cache is clean if nothing it was computed from has changed:
+	return !(world_cache.valid
+	 && world_cache.position == position
+	 && world_cache.rotation == rotation
+	 && world_cache.scale == scale
+	 && world_cache.parent == parent
+	 && world_cache.enabled == enabled
+	 && (!parent || world_cache.parent_generation == parent->world_cache.generation));
+}
+
+void Scene::Transform::set_world_cache(glm::mat4x3 const &local_to_world) const {
+	world_cache.local_to_world = local_to_world;
+	world_cache.world_to_local_valid = false;
+	world_cache.normal_to_world_valid = false;
+
+	world_cache.position = position;
+	world_cache.rotation = rotation;
+	world_cache.scale = scale;
+	world_cache.parent = parent;
+	world_cache.enabled = enabled;
+	world_cache.enabled_in_hierarchy = enabled && (!parent || parent->world_cache.enabled_in_hierarchy);
+	if (parent) world_cache.parent_generation = parent->world_cache.generation;
+	world_cache.generation += 1;
+	world_cache.valid = true;
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -80,48 +167,485 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
+//helper: is the box [min,max] entirely outside the view frustum of object_to_clip?
+// (conservative: returns false for boxes that straddle frustum corners)
+bool box_outside_frustum(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec4 corners[8];
+	for (uint32_t c = 0; c < 8; ++c) {
+		corners[c] = object_to_clip * glm::vec4(
+			(c & 1 ? max.x : min.x),
+			(c & 2 ? max.y : min.y),
+			(c & 4 ? max.z : min.z),
+			1.0f
+		);
+	}
+	//check against each clip plane ( -w <= x,y,z <= w ):
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		bool all_below = true;
+		bool all_above = true;
+		for (uint32_t c = 0; c < 8; ++c) {
+			all_below = all_below && (corners[c][axis] < -corners[c].w);
+			all_above = all_above && (corners[c][axis] > corners[c].w);
+		}
+		if (all_below || all_above) return true;
+	}
+	return false;
+}
+
+//helper: world-space bounding sphere (xyz: center, w: radius) of the box [min,max] under object_to_world:
+// (empty boxes -- unknown bounds -- give a zero-radius sphere at the object's origin)
+glm::vec4 world_bounding_sphere(glm::mat4x3 const &object_to_world, glm::vec3 const &min, glm::vec3 const &max) {
+	if (!(min.x <= max.x)) return glm::vec4(object_to_world[3], 0.0f);
+	glm::vec3 center = object_to_world * glm::vec4(0.5f * (min + max), 1.0f);
+	float scale = std::max(glm::length(object_to_world[0]), std::max(glm::length(object_to_world[1]), glm::length(object_to_world[2])));
+	return glm::vec4(center, 0.5f * glm::length(max - min) * scale);
+}
+
+uint32_t Scene::pick_lights(glm::vec4 const &bounds, glm::vec4 lights_out[2]) const {
+	//lights whose best-case contribution is below one 8-bit step (on a white surface) aren't worth shading:
+	constexpr float MinScore = 1.0f / 256.0f;
+
+	glm::vec3 center = glm::vec3(bounds);
+	float radius = bounds.w;
+
+	//score each light by its (shader-equivalent) falloff at the closest point of the bounding sphere:
+	light_candidates.clear();
+	for (uint32_t i = 0; i < light_bins.size(); ++i) {
+		LightBin const &bin = light_bins[i];
+		float score = bin.strength;
+		if (bin.type == Light::Point || bin.type == Light::Spot) {
+			glm::vec3 to_center = center - bin.position;
+			float dis = glm::length(to_center);
+			//spot lights skip spheres entirely outside their cone:
+			if (bin.type == Light::Spot && dis > radius) {
+				float angle = std::acos(glm::clamp(glm::dot(to_center, bin.direction) / dis, -1.0f, 1.0f));
+				if (angle - std::asin(radius / dis) > bin.half_fov) continue;
+			}
+			float gap = std::max(0.0f, dis - radius);
+			score /= std::max(1.0f, gap * gap);
+		}
+		if (score < MinScore) continue;
+		light_candidates.emplace_back(score, i);
+	}
+
+	//keep the highest-scoring lights:
+	uint32_t count = std::min(uint32_t(MaxObjectLights), uint32_t(light_candidates.size()));
+	std::partial_sort(light_candidates.begin(), light_candidates.begin() + count, light_candidates.end(),
+		[](std::pair< float, uint32_t > const &a, std::pair< float, uint32_t > const &b) { return a.first > b.first; });
+	//(list in index order, so a list -- and the object data holding it -- only changes when the picks do)
+	std::sort(light_candidates.begin(), light_candidates.begin() + count,
+		[](std::pair< float, uint32_t > const &a, std::pair< float, uint32_t > const &b) { return a.second < b.second; });
+
+	for (uint32_t l = 0; l < MaxObjectLights; ++l) {
+		lights_out[l / 4][l % 4] = (l < count ? float(light_candidates[l].second) : -1.0f);
+	}
+	return count;
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+	draw(world_to_clip, world_to_light, camera.layers);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+void Scene::invalidate_draw_list() {
+	draw_list_dirty = true;
+}
+
+void Scene::compile_draw_list() const {
+	draw_list.clear();
+
+	//assign dense ranks to distinct programs, vertex arrays, and texture sets so they fit in the sort key:
+	typedef std::array< GLuint, 2 * Drawable::Pipeline::TextureCount > TextureSet;
+	auto texture_set = [](Drawable::Pipeline const &pipeline) {
+		TextureSet set;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			set[2*i+0] = pipeline.textures[i].texture;
+			set[2*i+1] = pipeline.textures[i].target;
+		}
+		return set;
+	};
+	std::map< GLuint, uint64_t > program_rank;
+	std::map< GLuint, uint64_t > vao_rank;
+	std::map< TextureSet, uint64_t > textures_rank;
+	for (auto const &drawable : drawables) {
+		Drawable::Pipeline const &pipeline = this->pipeline(drawable);
+		program_rank.emplace(pipeline.program, 0);
+		vao_rank.emplace(pipeline.vao, 0);
+		textures_rank.emplace(texture_set(pipeline), 0);
+	}
+	auto assign_ranks = [](auto &ranks, uint64_t max_rank) {
+		uint64_t rank = 0;
+		for (auto &r : ranks) {
+			r.second = std::min(rank, max_rank); //(sorting gets coarser past max_rank, but stays correct)
+			rank += 1;
+		}
+	};
+	assign_ranks(program_rank, DrawKeyProgramMask);
+	assign_ranks(vao_rank, DrawKeyVAOMask);
+	assign_ranks(textures_rank, DrawKeyTexturesMask);
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	size_t object_count = 0;
 	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		Drawable::Pipeline const &pipeline = this->pipeline(drawable);
 
 		//skip any drawables without a shader program set:
 		if (pipeline.program == 0) continue;
 		//skip any drawables that don't reference any vertex array:
 		if (pipeline.vao == 0) continue;
+
+		DrawItem item;
+		item.key = (program_rank.at(pipeline.program) << DrawKeyProgramShift)
+		         | (vao_rank.at(pipeline.vao) << DrawKeyVAOShift)
+		         | (textures_rank.at(texture_set(pipeline)) << DrawKeyTexturesShift);
+		item.drawable = &drawable;
+		item.pipeline = &pipeline;
+		if (pipeline.OBJECT_INDEX_int != -1U) item.object_index = uint32_t(object_count++);
+		draw_list.emplace_back(item);
+	}
+
+	//(re-)allocate the object buffer; the zeroed mirror is uploaded whole, and draw() patches it as objects become visible:
+	object_data.assign(object_count, ObjectData());
+	object_sources.assign(object_count, ObjectSource());
+	object_dirty.clear();
+	if (object_count > 0) {
+		if (object_buffer == 0) {
+			glGenBuffers(1, &object_buffer);
+			glGenTextures(1, &object_buffer_texture);
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, object_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, object_data.size() * sizeof(ObjectData), object_data.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glBindTexture(GL_TEXTURE_BUFFER, object_buffer_texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, object_buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	draw_list_version = drawables.version;
+	draw_list_dirty = false;
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, uint32_t layers) const {
+	//nothing moves while drawing, so each transform's world cache only needs to be checked once:
+	uint32_t check = new_world_check();
+
+	//normals go to light space via inverse-transpose(world_to_light) * normal_to_world:
+	glm::mat3 world_normal_to_light = glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+
+	draw_stats = DrawStats();
+
+	//Gather lights into the light buffer (lights are transformed to light space, as positions and normals are):
+	light_data.clear();
+	std::swap(light_bins, previous_light_bins);
+	light_bins.clear();
+	for (auto const &light : lights) {
+		assert(light.transform); //lights *must* have a transform
+		light.transform->update_world_cache(check);
+		if (!light.transform->world_cache.enabled_in_hierarchy) continue;
+		glm::mat4x3 const &light_to_world = light.transform->world_cache.local_to_world;
+
+		LightBin bin;
+		bin.type = light.type;
+		bin.position = light_to_world[3];
+		bin.direction = -glm::normalize(light_to_world[2]); //lights are directed along their -z axis
+		bin.half_fov = 0.5f * light.spot_fov;
+		bin.strength = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		light_bins.emplace_back(bin);
+
+		float type = 0.0f;
+		if (light.type == Light::Point) type = 0.0f;
+		else if (light.type == Light::Hemisphere) type = 1.0f;
+		else if (light.type == Light::Spot) type = 2.0f;
+		else if (light.type == Light::Directional) type = 3.0f;
+
+		LightData data;
+		data.position_type = glm::vec4(world_to_light * glm::vec4(bin.position, 1.0f), type);
+		data.direction_cutoff = glm::vec4(glm::normalize(glm::mat3(world_to_light) * bin.direction), std::cos(bin.half_fov));
+		data.energy = glm::vec4(light.energy, 0.0f);
+		light_data.emplace_back(data);
+	}
+	if (!light_data.empty()) {
+		if (light_buffer == 0) {
+			//(a buffer name only becomes a buffer object once it is bound, so give it storage before attaching the texture view)
+			glGenBuffers(1, &light_buffer);
+			glGenTextures(1, &light_buffer_texture);
+			glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+			glBufferData(GL_TEXTURE_BUFFER, light_data.size() * sizeof(LightData), light_data.data(), GL_STREAM_DRAW);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+			glBindTexture(GL_TEXTURE_BUFFER, light_buffer_texture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, light_buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+			GL_ERRORS(); //PARANOIA: make sure the buffer and its texture view were set up
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, light_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, light_data.size() * sizeof(LightData), light_data.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+	draw_stats.lights = uint32_t(light_data.size());
+
+	//if the lights moved (or changed), every object's light picks need recomputing:
+	bool lights_changed = (light_bins.size() != previous_light_bins.size());
+	for (uint32_t i = 0; i < light_bins.size() && !lights_changed; ++i) {
+		LightBin const &a = light_bins[i];
+		LightBin const &b = previous_light_bins[i];
+		lights_changed = (a.type != b.type || a.position != b.position || a.direction != b.direction
+			|| a.half_fov != b.half_fov || a.strength != b.strength);
+	}
+
+	if (draw_list_dirty || draw_list_version != drawables.version) {
+		compile_draw_list();
+	}
+
+	//Gather visible drawables into the draw queue:
+	bool use_occlusion = (occlusion && occlusion->world_to_clip == world_to_clip);
+	draw_queue.clear();
+	for (auto const &compiled : draw_list) {
+		Drawable const &drawable = *compiled.drawable;
+
+		//skip any drawables that are switched off (checked first, so hidden drawables cost no matrix or GL work):
+		assert(drawable.transform); //drawables *must* have a transform
+		if (!drawable.enabled || !(drawable.layers & layers)) {
+			draw_stats.hidden += 1;
+			continue;
+		}
+		drawable.transform->update_world_cache(check);
+		if (!drawable.transform->world_cache.enabled_in_hierarchy) {
+			draw_stats.hidden += 1;
+			continue;
+		}
+
+		//the object-to-world matrix is used for culling and in all three of the uniforms below:
+		glm::mat4x3 const &object_to_world = drawable.transform->world_cache.local_to_world;
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+
+		//skip any drawables whose bounds are entirely off-screen:
+		if (drawable.min.x <= drawable.max.x && box_outside_frustum(object_to_clip, drawable.min, drawable.max)) {
+			draw_stats.culled += 1;
+			continue;
+		}
+
+		//skip any drawables whose bounds are hidden behind occluders:
+		if (use_occlusion && drawable.min.x <= drawable.max.x && occlusion->occluded(object_to_clip, drawable.min, drawable.max)) {
+			draw_stats.occluded += 1;
+			continue;
+		}
+
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		// (checked per-frame since start/count may change without recompiling;
+		//  checked last, so only drawables that would otherwise be drawn read their pipeline)
+		if (compiled.pipeline->count == 0) continue;
+
+		//depth (clip 'w' of the object's origin) sorts front-to-back within each state group;
+		// bits of a non-negative float sort in the same order as its value:
+		float depth = std::max(0.0f, object_to_clip[3].w);
+		uint32_t depth_bits;
+		std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+		DrawItem item = compiled;
+		item.key |= uint64_t(depth_bits >> (32 - DrawKeyDepthBits));
+		item.object_to_world = object_to_world;
+		item.object_to_clip = object_to_clip;
+		item.bounds = world_bounding_sphere(object_to_world, drawable.min, drawable.max);
+		draw_queue.emplace_back(item);
+
+		//update this object's entry in the object buffer mirror, noting it for upload if it changed:
+		if (item.object_index != -1U) {
+			//entries computed from this same world cache (and the same lights) are already current:
+			ObjectSource &source = object_sources[item.object_index];
+			if (!lights_changed && source.transform == drawable.transform
+			 && source.generation == drawable.transform->world_cache.generation && source.bounds == item.bounds) {
+				draw_stats.light_assignments += source.light_count;
+				continue;
+			}
+			source.transform = drawable.transform;
+			source.generation = drawable.transform->world_cache.generation;
+			source.bounds = item.bounds;
+
+			glm::mat3 normal_to_world = drawable.transform->cached_normal_to_world();
+			ObjectData data;
+			for (uint32_t r = 0; r < 3; ++r) {
+				data.object_to_world[r] = glm::vec4(object_to_world[0][r], object_to_world[1][r], object_to_world[2][r], object_to_world[3][r]);
+				data.normal_to_world[r] = glm::vec4(normal_to_world[0][r], normal_to_world[1][r], normal_to_world[2][r], 0.0f);
+			}
+			source.light_count = pick_lights(item.bounds, data.lights);
+			draw_stats.light_assignments += source.light_count;
+			if (std::memcmp(&data, &object_data[item.object_index], sizeof(ObjectData)) != 0) {
+				object_data[item.object_index] = data;
+				//draw_list is in object_index order, so ranges grow at the end;
+				// nearby changes are merged, since one slightly larger upload beats two calls:
+				constexpr uint32_t MergeGap = 16;
+				if (!object_dirty.empty() && item.object_index <= object_dirty.back().second + MergeGap) {
+					object_dirty.back().second = item.object_index + 1;
+				} else {
+					object_dirty.emplace_back(item.object_index, item.object_index + 1);
+				}
+				draw_stats.objects_uploaded += 1;
+			}
+		}
+	}
+
+	//upload changed ranges of the object buffer:
+	if (!object_dirty.empty()) {
+		glBindBuffer(GL_TEXTURE_BUFFER, object_buffer);
+		for (auto const &range : object_dirty) {
+			glBufferSubData(GL_TEXTURE_BUFFER,
+				range.first * sizeof(ObjectData),
+				(range.second - range.first) * sizeof(ObjectData),
+				object_data.data() + range.first
+			);
+			draw_stats.object_uploads += 1;
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		object_dirty.clear();
+	}
+
+	std::sort(draw_queue.begin(), draw_queue.end(), [](DrawItem const &a, DrawItem const &b) {
+		return a.key < b.key;
+	});
+
+	//Find runs of drawables that can share one instanced draw call:
+	// (same program/vao/textures, same vertex range, an instanced pipeline, and no custom uniforms)
+	instance_queue.clear();
+	for (uint32_t i = 0; i < draw_queue.size(); ++i) {
+		Drawable::Pipeline const &pipeline = *draw_queue[i].pipeline;
+		if (pipeline.instanced.program != 0 && pipeline.instanced.vao != 0 && pipeline.instanced.instance_buffer != 0 && !pipeline.set_uniforms) {
+			instance_queue.emplace_back(i);
+		}
+	}
+	auto same_batch = [this](uint32_t a, uint32_t b) {
+		DrawItem const &ia = draw_queue[a];
+		DrawItem const &ib = draw_queue[b];
+		Drawable::Pipeline const &pa = *ia.pipeline;
+		Drawable::Pipeline const &pb = *ib.pipeline;
+		if ((ia.key >> DrawKeyDepthBits) != (ib.key >> DrawKeyDepthBits)) return false;
+		if (pa.program != pb.program || pa.vao != pb.vao) return false;
+		if (pa.instanced.program != pb.instanced.program || pa.instanced.vao != pb.instanced.vao) return false;
+		if (pa.type != pb.type || pa.start != pb.start || pa.count != pb.count) return false;
+		//(texture ranks in the key may be clamped, so compare textures directly)
+		for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+			if (pa.textures[t].texture != pb.textures[t].texture || pa.textures[t].target != pb.textures[t].target) return false;
+		}
+		return true;
+	};
+	//(stable sort keeps batches front-to-back)
+	std::stable_sort(instance_queue.begin(), instance_queue.end(), [this](uint32_t a, uint32_t b) {
+		DrawItem const &ia = draw_queue[a];
+		DrawItem const &ib = draw_queue[b];
+		if ((ia.key >> DrawKeyDepthBits) != (ib.key >> DrawKeyDepthBits)) return ia.key < ib.key;
+		Drawable::Pipeline const &pa = *ia.pipeline;
+		Drawable::Pipeline const &pb = *ib.pipeline;
+		if (pa.start != pb.start) return pa.start < pb.start;
+		if (pa.count != pb.count) return pa.count < pb.count;
+		return pa.type < pb.type;
+	});
+	//mark runs of at least two as batched (single drawables are cheaper to draw normally):
+	for (uint32_t begin = 0; begin < instance_queue.size(); /* later */) {
+		uint32_t end = begin + 1;
+		while (end < instance_queue.size() && same_batch(instance_queue[begin], instance_queue[end])) ++end;
+		for (uint32_t i = begin; i < end; ++i) {
+			draw_queue[instance_queue[i]].batched = (end - begin >= 2);
+		}
+		begin = end;
+	}
+
+	//Send queued drawables to OpenGL, only changing state that differs from the previous draw:
+	GLuint current_program = 0;
+	GLuint current_vao = 0;
+	Drawable::Pipeline::TextureInfo current_textures[Drawable::Pipeline::TextureCount];
+
+	auto set_program_and_vao = [&](GLuint program, GLuint vao) {
+		if (program != current_program) {
+			glUseProgram(program);
+			current_program = program;
+			draw_stats.state_changes += 1;
+		}
+		if (vao != current_vao) {
+			glBindVertexArray(vao);
+			current_vao = vao;
+			draw_stats.state_changes += 1;
+		}
+	};
+
+	//set up textures (un-binding any left over from the previous draw that this one doesn't use):
+	auto set_textures = [&](Drawable::Pipeline const &pipeline) {
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			auto const &want = pipeline.textures[i];
+			auto &have = current_textures[i];
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+			glActiveTexture(GL_TEXTURE0 + i);
+			if (have.texture != 0 && (want.texture == 0 || want.target != have.target)) {
+				glBindTexture(have.target, 0);
+				draw_stats.state_changes += 1;
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
+				draw_stats.state_changes += 1;
+			}
+			have = want;
+		}
+	};
+
+	//programs that read the object buffer get world-space uniforms once per draw() call:
+	std::vector< GLuint > world_uniforms_set;
+	auto set_world_uniforms = [&](Drawable::Pipeline const &pipeline) {
+		if (std::find(world_uniforms_set.begin(), world_uniforms_set.end(), pipeline.program) != world_uniforms_set.end()) return;
+		world_uniforms_set.emplace_back(pipeline.program);
+		if (pipeline.WORLD_TO_CLIP_mat4 != -1U) {
+			glUniformMatrix4fv(pipeline.WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+		}
+		if (pipeline.WORLD_TO_LIGHT_mat4x3 != -1U) {
+			glUniformMatrix4x3fv(pipeline.WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+		}
+		if (pipeline.WORLD_NORMAL_TO_LIGHT_mat3 != -1U) {
+			glUniformMatrix3fv(pipeline.WORLD_NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(world_normal_to_light));
+		}
+	};
+
+	if (object_buffer_texture != 0) {
+		glActiveTexture(GL_TEXTURE0 + ObjectBufferUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, object_buffer_texture);
+	}
+	if (light_buffer_texture != 0) {
+		glActiveTexture(GL_TEXTURE0 + LightBufferUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, light_buffer_texture);
+	}
 
+	for (auto const &item : draw_queue) {
+		Drawable const &drawable = *item.drawable;
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = *item.pipeline;
+
+		draw_stats.drawn += 1;
+		//(the per-drawable approach binds program + vao, then binds and un-binds each texture:)
+		draw_stats.naive_state_changes += 2;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (pipeline.textures[i].texture != 0) draw_stats.naive_state_changes += 2;
+		}
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+		//batched drawables are drawn below:
+		if (item.batched) continue;
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		//Set shader program and attribute sources:
+		set_program_and_vao(pipeline.program, pipeline.vao);
 
 		//Configure program uniforms:
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		//programs reading the object buffer just need to know where to look:
+		if (item.object_index != -1U) {
+			set_world_uniforms(pipeline);
+			glUniform1i(pipeline.OBJECT_INDEX_int, GLint(item.object_index));
+		}
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(item.object_to_clip));
 		}
 
 		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+		glm::mat4x3 object_to_light = world_to_light * glm::mat4(item.object_to_world);
 
 		//OBJECT_TO_CLIP takes vertices from object space to light space:
 		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
@@ -130,34 +654,92 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 
 		//NORMAL_TO_CLIP takes normals from object space to light space:
 		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+			glm::mat3 normal_to_light = world_normal_to_light * drawable.transform->cached_normal_to_world();
 			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 		}
 
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
-		}
+		set_textures(pipeline);
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+	//Draw batches with one instanced call each:
+	for (uint32_t begin = 0; begin < instance_queue.size(); /* later */) {
+		if (!draw_queue[instance_queue[begin]].batched) {
+			++begin;
+			continue;
+		}
+		uint32_t end = begin + 1;
+		while (end < instance_queue.size() && same_batch(instance_queue[begin], instance_queue[end])) ++end;
+
+		Drawable::Pipeline const &pipeline = *draw_queue[instance_queue[begin]].pipeline;
+
+		//gather per-instance matrices:
+		instance_data.clear();
+		for (uint32_t i = begin; i < end; ++i) {
+			DrawItem const &item = draw_queue[instance_queue[i]];
+			instance_data.emplace_back();
+			instance_data.back().object_to_world = item.object_to_world;
+			instance_data.back().normal_to_world = item.drawable->transform->cached_normal_to_world();
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, pipeline.instanced.instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, instance_data.size() * sizeof(Instance), instance_data.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		set_program_and_vao(pipeline.instanced.program, pipeline.instanced.vao);
+
+		if (pipeline.instanced.WORLD_TO_CLIP_mat4 != -1U) {
+			glUniformMatrix4fv(pipeline.instanced.WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+		}
+		if (pipeline.instanced.WORLD_TO_LIGHT_mat4x3 != -1U) {
+			glUniformMatrix4x3fv(pipeline.instanced.WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+		}
+		if (pipeline.instanced.WORLD_NORMAL_TO_LIGHT_mat3 != -1U) {
+			glUniformMatrix3fv(pipeline.instanced.WORLD_NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(world_normal_to_light));
+		}
+		//lights for the whole batch are picked using a sphere around all of its instances:
+		if (pipeline.instanced.LIGHT_INDICES_vec4 != -1U) {
+			glm::vec3 lo = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 hi = glm::vec3(-std::numeric_limits< float >::infinity());
+			for (uint32_t i = begin; i < end; ++i) {
+				glm::vec4 const &bounds = draw_queue[instance_queue[i]].bounds;
+				lo = glm::min(lo, glm::vec3(bounds) - bounds.w);
+				hi = glm::max(hi, glm::vec3(bounds) + bounds.w);
 			}
+			glm::vec4 batch_lights[2];
+			draw_stats.light_assignments += pick_lights(glm::vec4(0.5f * (lo + hi), 0.5f * glm::length(hi - lo)), batch_lights);
+			glUniform4fv(pipeline.instanced.LIGHT_INDICES_vec4, 2, glm::value_ptr(batch_lights[0]));
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		set_textures(pipeline);
+
+		glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, GLsizei(instance_data.size()));
+		draw_stats.instanced_batches += 1;
+		draw_stats.instanced_drawables += end - begin;
+
+		begin = end;
+	}
+
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (current_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(current_textures[i].target, 0);
+		}
+	}
+	if (object_buffer_texture != 0) {
+		glActiveTexture(GL_TEXTURE0 + ObjectBufferUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	if (light_buffer_texture != 0) {
+		glActiveTexture(GL_TEXTURE0 + LightBufferUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
 	}
+	glActiveTexture(GL_TEXTURE0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -169,53 +751,40 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
-
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
-
-	struct HierarchyEntry {
-		uint32_t parent;
-		uint32_t name_begin;
-		uint32_t name_end;
-		glm::vec3 position;
-		glm::quat rotation;
-		glm::vec3 scale;
-	};
-	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
-
-	struct MeshEntry {
-		uint32_t transform;
-		uint32_t name_begin;
-		uint32_t name_end;
-	};
-	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
-
-	struct CameraEntry {
-		uint32_t transform;
-		char type[4]; //"pers" or "orth"
-		float data; //fov in degrees for 'pers', scale for 'orth'
-		float clip_near, clip_far;
-	};
-	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
-
-	struct LightEntry {
-		uint32_t transform;
-		char type;
-		glm::u8vec3 color;
-		float energy;
-		float distance;
-		float fov;
-	};
-	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	//file is parsed in place; entries are read straight from the mapping:
+	MappedFile file(filename);
+
+	using namespace SceneFormat;
+	ChunkSpan< char > names;
+	ChunkSpan< HierarchyEntry > hierarchy;
+	ChunkSpan< MeshEntry > meshes;
+	ChunkSpan< CameraEntry > loaded_cameras;
+	ChunkSpan< LightEntry > loaded_lights;
+	char const *extra_begin = nullptr; //data for load_extra
+	char const *extra_end = nullptr;
+
+	ChunkReader reader(file.begin(), file.end()); //(owns copies of misaligned version 1 payloads)
+	if (is_v2(file.begin(), file.end())) {
+		//version 2: look chunks up in the table of contents:
+		Toc toc(file.begin(), file.end());
+		names = toc.read< char >("str0");
+		hierarchy = toc.read< HierarchyEntry >("xfh0");
+		meshes = toc.read< MeshEntry >("msh0");
+		loaded_cameras = toc.read< CameraEntry >("cam0");
+		loaded_lights = toc.read< LightEntry >("lmp0");
+		ChunkSpan< char > extra = toc.read_optional< char >("ext0");
+		extra_begin = extra.begin();
+		extra_end = extra.end();
+	} else {
+		//version 1: fixed chunk sequence, followed by any extra data:
+		names = reader.read< char >("str0");
+		hierarchy = reader.read< HierarchyEntry >("xfh0");
+		meshes = reader.read< MeshEntry >("msh0");
+		loaded_cameras = reader.read< CameraEntry >("cam0");
+		loaded_lights = reader.read< LightEntry >("lmp0");
+		extra_begin = reader.at;
+		extra_end = reader.end;
+	}
 
 
 	//--------------------------------
@@ -225,8 +794,7 @@ void Scene::load(std::string const &filename,
 	hierarchy_transforms.reserve(hierarchy.size());
 
 	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
+		Transform *t = &append_transform(&transforms);
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
@@ -301,23 +869,67 @@ void Scene::load(std::string const &filename,
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
 
+	//add the new transforms' names to the index, using precomputed hashes from the file where present:
+	// (load() adds to any existing transforms; an index that was out of date before is rebuilt)
+	{
+		ChunkSpan< uint32_t > name_hashes;
+		if (is_v2(file.begin(), file.end())) {
+			name_hashes = Toc(file.begin(), file.end()).read_optional< uint32_t >("nhs0");
+		}
+		bool use_hashes = (name_hashes.size() == hierarchy.size() && !name_hashes.empty());
+		index_names(std::prev(transforms.end(), hierarchy.size()), use_hashes ? name_hashes.data() : nullptr);
+	}
+
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	// (load_extra's interface predates in-place reading, so it gets a stream over the rest of the mapping and a copy of the names)
+	MemoryStreambuf rest_buf(extra_begin, extra_end);
+	std::istream rest(&rest_buf);
+	load_extra(rest, std::vector< char >(names.begin(), names.end()), hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (rest.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
+	if (flatten_on_load) {
+		//(transforms from before this load count as referenced, so only the new ones are folded)
+		std::unordered_set< Transform const * > loaded(hierarchy_transforms.begin(), hierarchy_transforms.end());
+		load_flatten_stats = flatten([this, &loaded](Transform const &t) {
+			if (!loaded.count(&t)) return true;
+			return flatten_referenced ? flatten_referenced(t) : !t.name.empty();
+		});
+	}
 
 
 }
 
 //-------------------------
 
+Scene::Scene() {
+}
+
 Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 	load(filename, on_drawable);
 }
 
+Scene::~Scene() {
+	if (object_buffer_texture != 0) {
+		glDeleteTextures(1, &object_buffer_texture);
+		object_buffer_texture = 0;
+	}
+	if (object_buffer != 0) {
+		glDeleteBuffers(1, &object_buffer);
+		object_buffer = 0;
+	}
+	if (light_buffer_texture != 0) {
+		glDeleteTextures(1, &light_buffer_texture);
+		light_buffer_texture = 0;
+	}
+	if (light_buffer != 0) {
+		glDeleteBuffers(1, &light_buffer);
+		light_buffer = 0;
+	}
+}
+
 Scene::Scene(Scene const &other) {
 	set(other);
 }
@@ -327,51 +939,655 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
-
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
+	if (&other == this) return;
+
+	//Match the number of transforms, keeping (rather than reallocating) existing list nodes:
+	transforms.resize(other.transforms.size());
+
+	//Copy transforms, numbering other's transforms so that pointers can be fixed up by index:
+	std::vector< Transform * > by_index;
+	by_index.reserve(other.transforms.size());
+	std::vector< Transform const * > sources; //other's transforms by index, for checking pointers being fixed up
+	sources.reserve(other.transforms.size());
+	{
+		uint32_t index = 0;
+		auto out = transforms.begin();
+		for (auto const &t : other.transforms) {
+			t.copy_index = index++;
+			out->name = t.name;
+			out->position = t.position;
+			out->rotation = t.rotation;
+			out->scale = t.scale;
+			out->enabled = t.enabled;
+			out->world_cache = t.world_cache; //parent is fixed up below
+			by_index.emplace_back(&*out);
+			sources.emplace_back(&t);
+			++out;
+		}
+	}
+	auto fixup = [&](Transform const *t) -> Transform * {
+		if (t == nullptr) return nullptr;
+		//(a pointer to a transform in some other scene would read a stale copy_index, silently picking the wrong transform)
+		if (!(t->copy_index < sources.size() && sources[t->copy_index] == t)) {
+			throw std::runtime_error("Scene copy: a transform pointer refers to a transform outside the scene being copied.");
+		}
+		return by_index[t->copy_index];
+	};
 
-	//Copy transforms and store mapping:
-	transforms.clear();
-	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+	//update transform parents:
+	{
+		auto out = transforms.begin();
+		for (auto const &t : other.transforms) {
+			out->parent = fixup(t.parent);
+			//a cache computed under a different parent is stale anyway (and that parent may no longer exist):
+			if (t.world_cache.parent == t.parent) {
+				out->world_cache.parent = out->parent;
+			} else {
+				out->world_cache.parent = nullptr;
+				out->world_cache.valid = false;
+			}
+			++out;
+		}
+	}
 
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+	if (transform_map) {
+		transform_map->clear();
+		//null transform maps to itself:
+		transform_map->insert(std::make_pair(nullptr, nullptr));
+		for (auto const &t : other.transforms) {
+			transform_map->insert(std::make_pair(&t, by_index[t.copy_index]));
+		}
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//copy other's name index, updating transform pointers:
+	// (an out-of-date index may point to removed transforms, so it is dropped instead -- the next lookup rebuilds it)
+	if (other.name_index.valid) {
+		name_index = other.name_index;
+		for (auto &e : name_index.entries) {
+			e.transform = fixup(e.transform);
+		}
+	} else {
+		name_index = NameIndex();
 	}
 
 	//copy other's drawables, updating transform pointers:
+	// (assignment reuses the existing array's storage)
 	drawables = other.drawables;
+	invalidate_draw_list(); //draw list was compiled from different drawable contents
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = fixup(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = fixup(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = fixup(l.transform);
+	}
+}
+
+//-------------------------
+
+void Scene::reparent(Transform *transform, Transform *new_parent) {
+	assert(transform);
+	for (Transform const *t = new_parent; t; t = t->parent) {
+		if (t == transform) {
+			throw std::runtime_error("Can't make transform '" + transform->name + "' a child of itself or of one of its descendants.");
+		}
+	}
+
+	//find 'transform', noting whether 'new_parent' comes before it:
+	auto at = transforms.begin();
+	bool parent_first = false;
+	for (; at != transforms.end(); ++at) {
+		if (&*at == transform) break;
+		if (&*at == new_parent) parent_first = true;
+	}
+	if (at == transforms.end()) throw std::runtime_error("Reparenting transform '" + transform->name + "' that isn't in this scene.");
+
+	if (new_parent && !parent_first) {
+		//continue the sweep to 'new_parent', collecting transform's subtree along the way
+		// (descendants after new_parent are already after it, so can stay where they are):
+		std::vector< std::list< Transform >::iterator > subtree;
+		std::unordered_set< Transform const * > moving;
+		for (; at != transforms.end() && &*at != new_parent; ++at) {
+			if (&*at == transform || (at->parent && moving.count(at->parent))) {
+				moving.insert(&*at);
+				subtree.emplace_back(at);
+			}
+		}
+		if (at == transforms.end()) throw std::runtime_error("Reparenting transform '" + transform->name + "' to a transform that isn't in this scene.");
+
+		//move the subtree (keeping its relative order) to just after new_parent:
+		auto insert_at = std::next(at);
+		for (auto const &t : subtree) {
+			transforms.splice(insert_at, transforms, t);
+		}
+	}
+
+	transform->parent = new_parent;
+}
+
+Scene::Transform *Scene::instantiate(Transform const *prefab_root, Transform *parent, std::unordered_map< Transform const *, Transform * > *transform_map) {
+	std::vector< Transform const * > subtree;
+	std::vector< Transform * > clones;
+	clone_subtree(prefab_root, parent, 1, &subtree, &clones);
+	if (transform_map) {
+		transform_map->clear();
+		for (size_t i = 0; i < subtree.size(); ++i) {
+			transform_map->emplace(subtree[i], clones[i]);
+		}
+	}
+	return clones[0];
+}
+
+std::vector< Scene::Transform * > Scene::instantiate(Transform const *prefab_root, Transform *parent, uint32_t count) {
+	std::vector< Transform const * > subtree;
+	std::vector< Transform * > clones;
+	clone_subtree(prefab_root, parent, count, &subtree, &clones);
+	std::vector< Transform * > roots;
+	roots.reserve(count);
+	for (uint32_t c = 0; c < count; ++c) {
+		roots.emplace_back(clones[c * subtree.size()]);
+	}
+	return roots;
+}
+
+void Scene::clone_subtree(Transform const *prefab_root, Transform *parent, uint32_t count,
+	std::vector< Transform const * > *subtree_, std::vector< Transform * > *clones_) {
+	assert(prefab_root);
+	assert(subtree_);
+	assert(clones_);
+	std::vector< Transform const * > &subtree = *subtree_;
+	std::vector< Transform * > &clones = *clones_;
+	subtree.clear();
+	clones.clear();
+
+	auto at = transforms.begin();
+	while (at != transforms.end() && &*at != prefab_root) ++at;
+	if (at == transforms.end()) throw std::runtime_error("Instantiating prefab '" + prefab_root->name + "' that isn't in this scene.");
+
+	//find the subtree in one forward sweep (descendants always follow their parents):
+	// (subtree_parent is the index of each transform's parent in 'subtree', or -1U for the root)
+	std::unordered_map< Transform const *, uint32_t > subtree_index;
+	std::vector< uint32_t > subtree_parent;
+	for (; at != transforms.end(); ++at) {
+		Transform const &t = *at;
+		uint32_t p = -1U;
+		if (&t != prefab_root) {
+			auto f = (t.parent ? subtree_index.find(t.parent) : subtree_index.end());
+			if (f == subtree_index.end()) continue; //not in the subtree
+			p = f->second;
+		}
+		subtree_index.emplace(&t, uint32_t(subtree.size()));
+		subtree.emplace_back(&t);
+		subtree_parent.emplace_back(p);
+	}
+	if (count == 0) return;
+
+	//clone the subtree 'count' times:
+	// (clones go in a separate list first, then are spliced on in bulk)
+	std::list< Transform > new_transforms;
+	clones.reserve(count * subtree.size());
+	for (uint32_t c = 0; c < count; ++c) {
+		uint32_t first = uint32_t(clones.size());
+		for (uint32_t i = 0; i < subtree.size(); ++i) {
+			Transform const &t = *subtree[i];
+			Transform &clone = append_transform(&new_transforms);
+			clone.name = t.name;
+			clone.position = t.position;
+			clone.rotation = t.rotation;
+			clone.scale = t.scale;
+			clone.enabled = t.enabled;
+			clone.parent = (subtree_parent[i] == -1U ? parent : clones[first + subtree_parent[i]]);
+			clones.emplace_back(&clone);
+		}
+	}
+
+	//clone attached objects onto the end of their stores:
+	// (space is reserved first, so appending never moves the objects being copied)
+	auto clone_attached = [&](auto *store) {
+		std::vector< std::pair< size_t, uint32_t > > attached; //(object index, subtree index)
+		for (size_t i = 0; i < store->size(); ++i) {
+			auto f = subtree_index.find((*store)[i].transform);
+			if (f != subtree_index.end()) attached.emplace_back(i, f->second);
+		}
+		if (attached.empty()) return false;
+		store->reserve(store->size() + count * attached.size());
+		for (uint32_t c = 0; c < count; ++c) {
+			for (auto const &a : attached) {
+				auto &clone = store->emplace_back((*store)[a.first]);
+				clone.transform = clones[c * subtree.size() + a.second];
+				store->cold(clone) = store->cold((*store)[a.first]); //(e.g., drawables' pipelines)
+			}
+		}
+		return true;
+	};
+	if (clone_attached(&drawables)) invalidate_draw_list();
+	clone_attached(&cameras);
+	clone_attached(&lights);
+
+	//appending keeps parents-before-children order, since 'parent' is already in the list:
+	auto first_clone = new_transforms.begin();
+	transforms.splice(transforms.end(), new_transforms);
+	index_names(first_clone);
+}
+
+void Scene::remove(Transform *root) {
+	remove(std::vector< Transform * >{root});
+}
+
+void Scene::remove(std::vector< Transform * > const &roots) {
+	if (roots.empty()) return;
+	std::unordered_set< Transform const * > root_set(roots.begin(), roots.end());
+	assert(!root_set.count(nullptr));
+
+	//find the subtrees in one forward sweep, before changing anything:
+	std::unordered_set< Transform const * > removed;
+	auto first = transforms.end();
+	for (auto t = transforms.begin(); t != transforms.end(); ++t) {
+		if (root_set.count(&*t) || (t->parent && removed.count(t->parent))) {
+			removed.insert(&*t);
+			if (first == transforms.end()) first = t;
+		}
+	}
+	for (auto root : roots) {
+		if (!removed.count(root)) throw std::runtime_error("Removing transform '" + root->name + "' that isn't in this scene.");
+	}
+
+	//drop attached objects first, while their transforms can still be checked:
+	auto attached = [&removed](auto const &object) { return removed.count(object.transform) != 0; };
+	size_t drawable_count = drawables.size();
+	drawables.remove_if(attached);
+	if (drawables.size() != drawable_count) invalidate_draw_list();
+	cameras.remove_if(attached);
+	lights.remove_if(attached);
+
+	//unlink removed transforms from the name index, walking each affected name's entries once:
+	// (if the index is out of date, the next lookup rebuilds it anyway)
+	if (name_index.valid) {
+		NameIndex &index = name_index;
+		std::unordered_set< uint32_t > names;
+		for (Transform const *t : removed) {
+			names.insert(find_name(t->name, SceneFormat::name_hash(t->name)));
+		}
+		size_t unlinked = 0;
+		for (uint32_t n : names) {
+			if (n == -1U) continue;
+			uint32_t prev = -1U;
+			for (uint32_t e = index.head[n]; e != -1U; ) {
+				uint32_t next = index.entries[e].next;
+				if (removed.count(index.entries[e].transform)) {
+					if (prev == -1U) index.head[n] = next;
+					else index.entries[prev].next = next;
+					index.entries[e].transform = nullptr;
+					index.entries[e].next = index.free_entries;
+					index.free_entries = e;
+					unlinked += 1;
+				} else {
+					prev = e;
+				}
+				e = next;
+			}
+			index.tail[n] = prev;
+		}
+		index.count -= unlinked;
+		//(a removed transform that wasn't found was renamed since it was indexed, so the index is stale)
+		if (unlinked != removed.size()) name_index = NameIndex();
+	}
+
+	//keep the removed transforms' list nodes for instantiate():
+	for (auto at = first; at != transforms.end(); ) {
+		auto next = std::next(at);
+		if (removed.count(&*at)) transform_pool.splice(transform_pool.end(), transforms, at);
+		at = next;
+	}
+}
+
+void Scene::reserve_transforms(size_t count) {
+	while (transform_pool.size() < count) {
+		transform_pool.emplace_back();
+	}
+}
+
+Scene::Transform &Scene::append_transform(std::list< Transform > *to) {
+	assert(to);
+	if (transform_pool.empty()) {
+		to->emplace_back();
+		return to->back();
+	}
+	to->splice(to->end(), transform_pool, transform_pool.begin());
+	Transform &t = to->back();
+	t.name.clear();
+	t.position = glm::vec3(0.0f);
+	t.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	t.scale = glm::vec3(1.0f);
+	t.parent = nullptr;
+	t.enabled = true;
+	//the cache belongs to whatever the transform was before, but its generation is kept,
+	// so anything that recorded the old generation (e.g., object_sources) sees a change:
+	uint32_t generation = t.world_cache.generation;
+	t.world_cache = Transform::WorldCache();
+	t.world_cache.generation = generation;
+	t.copy_index = -1U;
+	return t;
+}
+
+bool Scene::in_topological_order() const {
+	std::unordered_set< Transform const * > seen;
+	seen.reserve(transforms.size());
+	for (auto const &t : transforms) {
+		if (t.parent && !seen.count(t.parent)) return false;
+		seen.insert(&t);
+	}
+	return true;
+}
+
+uint32_t Scene::new_world_check() {
+	//(zero is what new caches start with, so it's skipped)
+	static uint32_t next = 0;
+	next += 1;
+	if (next == 0) next = 1;
+	return next;
+}
+
+void Scene::update_world_caches() const {
+	for (auto const &t : transforms) {
+		t.update_world_cache_from_parent();
+	}
+}
+
+void Scene::update_world_caches(WorkerPool &pool) const {
+	if (!world_store) world_store.reset(new TransformStore);
+	world_store->mirror(*this);
+	world_store->update_world(pool);
+
+	//only store matrices into caches that are dirty, so generations change just as with the serial pass:
+	// (in topological order, each parent's generation is final by the time its children are checked)
+	uint32_t i = 0;
+	for (auto const &t : transforms) {
+		if (t.world_cache_dirty()) t.set_world_cache(world_store->local_to_world[i]);
+		++i;
+	}
+}
+
+Scene::FlattenStats Scene::flatten(std::function< bool(Transform const &) > const &referenced, float tolerance) {
+	FlattenStats stats;
+
+	auto max_depth = [this]() {
+		uint32_t depth = 0;
+		for (auto const &t : transforms) {
+			uint32_t d = 0;
+			for (Transform const *at = &t; at; at = at->parent) ++d;
+			depth = std::max(depth, d);
+		}
+		return depth;
+	};
+	stats.depth_before = max_depth();
+
+	std::unordered_set< Transform const * > attached;
+	for (auto const &drawable : drawables) attached.insert(drawable.transform);
+	for (auto const &camera : cameras) attached.insert(camera.transform);
+	for (auto const &light : lights) attached.insert(light.transform);
+
+	std::unordered_map< Transform const *, std::vector< Transform * > > children;
+	for (auto &t : transforms) {
+		if (t.parent) children[t.parent].emplace_back(&t);
+	}
+
+	//combine a parent's local transform with a child's, if the result is still position/rotation/scale:
+	// (exact when the parent's scale is uniform -- so it commutes with the child's rotation -- or the child is unrotated)
+	auto combine = [tolerance](Transform const &parent, Transform const &child, Transform *out) {
+		glm::vec3 const &s = parent.scale;
+		float s_max = std::max(std::abs(s.x), std::max(std::abs(s.y), std::abs(s.z)));
+		bool uniform = std::abs(s.x - s.y) <= tolerance * s_max && std::abs(s.y - s.z) <= tolerance * s_max;
+		bool unrotated = 1.0f - std::abs(child.rotation.w) <= tolerance;
+		if (uniform) {
+			out->rotation = parent.rotation * child.rotation;
+		} else if (unrotated) {
+			out->rotation = parent.rotation;
+		} else {
+			return false;
+		}
+		out->scale = s * child.scale;
+		out->position = parent.position + parent.rotation * (s * child.position);
+
+		//check against the product of the original matrices (relative to each column's magnitude):
+		glm::mat4 expected = glm::mat4(parent.make_local_to_parent()) * glm::mat4(child.make_local_to_parent());
+		glm::mat4x3 combined = out->make_local_to_parent();
+		for (uint32_t c = 0; c < 4; ++c) {
+			float magnitude = std::max(1.0f, std::max(std::abs(expected[c][0]), std::max(std::abs(expected[c][1]), std::abs(expected[c][2]))));
+			for (uint32_t r = 0; r < 3; ++r) {
+				if (std::abs(combined[c][r] - expected[c][r]) > tolerance * magnitude) return false;
+			}
+		}
+		return true;
+	};
+
+	Transform scratch;
+	struct Local {
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	std::vector< Local > folded_locals;
+	auto pinned = [&](Transform const &t) {
+		return attached.count(&t) || (referenced ? referenced(t) : !t.name.empty());
+	};
+	for (auto t = transforms.begin(); t != transforms.end(); /* later */) {
+		Transform &folding = *t;
+		auto f = children.find(&folding);
+		//(a disabled transform hides its children, so it can't go away either)
+		bool fold = (f != children.end() && folding.enabled && !pinned(folding));
+		//check every child first, so the transform is folded into all of its children or none:
+		folded_locals.clear();
+		for (uint32_t i = 0; fold && i < f->second.size(); ++i) {
+			fold = !pinned(*f->second[i]) && combine(folding, *f->second[i], &scratch);
+			if (fold) folded_locals.emplace_back(Local{scratch.position, scratch.rotation, scratch.scale});
+		}
+		if (!fold) {
+			++t;
+			continue;
+		}
+
+		std::vector< Transform * > moved = std::move(f->second);
+		children.erase(f);
+		for (uint32_t i = 0; i < moved.size(); ++i) {
+			moved[i]->position = folded_locals[i].position;
+			moved[i]->rotation = folded_locals[i].rotation;
+			moved[i]->scale = folded_locals[i].scale;
+			moved[i]->parent = folding.parent;
+		}
+		if (folding.parent) {
+			std::vector< Transform * > &siblings = children[folding.parent];
+			siblings.erase(std::find(siblings.begin(), siblings.end(), &folding));
+			siblings.insert(siblings.end(), moved.begin(), moved.end());
+		}
+		//keep the folded transform's list node for instantiate(), as remove() does:
+		// (moving it out doesn't reorder the rest, so parents-before-children order is kept)
+		auto next = std::next(t);
+		transform_pool.splice(transform_pool.end(), transforms, t);
+		t = next;
+		stats.folded += 1;
+	}
+
+	//the index's entries for folded transforms now point into the pool, so rebuild it if it was built:
+	if (stats.folded != 0) {
+		if (name_index.valid) build_name_index();
+		else name_index = NameIndex();
+	}
+
+	stats.depth_after = max_depth();
+	return stats;
+}
+
+Scene::Snapshot Scene::snapshot() const {
+	Snapshot ret;
+	ret.transforms.reserve(transforms.size());
+	for (auto const &t : transforms) {
+		ret.transforms.emplace_back(Snapshot::TransformState{t.position, t.rotation, t.scale});
+	}
+	return ret;
+}
+
+void Scene::restore(Snapshot const &snapshot) {
+	if (snapshot.transforms.size() != transforms.size()) {
+		throw std::runtime_error("Snapshot has " + std::to_string(snapshot.transforms.size()) + " transforms, but scene has " + std::to_string(transforms.size()) + ".");
+	}
+	//(world caches notice changed values on their own, so there is nothing else to invalidate)
+	Snapshot::TransformState const *state = snapshot.transforms.data();
+	for (auto &t : transforms) {
+		t.position = state->position;
+		t.rotation = state->rotation;
+		t.scale = state->scale;
+		++state;
+	}
+}
+
+void Scene::Snapshot::save(std::ostream *to) const {
+	write_chunk("snp0", transforms, to);
+}
+
+void Scene::Snapshot::load(std::istream &from) {
+	read_chunk(from, "snp0", &transforms);
+}
+
+void Scene::build_name_index(uint32_t const *hashes) const {
+	name_index = NameIndex();
+
+	//table has at least twice as many slots as there could be names, so probe sequences stay short:
+	uint32_t slot_count = 1;
+	while (slot_count < 2 * transforms.size() + 1) slot_count *= 2;
+	name_index.slots.assign(slot_count, 0);
+	name_index.entries.reserve(transforms.size());
+	name_index.valid = true;
+
+	index_names(transforms.begin(), hashes);
+}
+
+void Scene::invalidate_name_index() {
+	name_index.valid = false;
+}
+
+void Scene::index_names(std::list< Transform >::const_iterator begin, uint32_t const *hashes) const {
+	//an out-of-date index can't be added to, so start over (hashes only cover all transforms if 'begin' is the first):
+	if (!name_index.valid) {
+		build_name_index(begin == transforms.begin() ? hashes : nullptr);
+		return;
+	}
+	NameIndex &index = name_index;
+
+	//intern a new name, growing (and rehashing) the table if it would become more than half full:
+	auto intern = [&index](std::string const &name, uint32_t hash) {
+		if (2 * (index.names.size() + 1) + 1 > index.slots.size()) {
+			uint32_t slot_count = std::max< uint32_t >(16, uint32_t(index.slots.size()));
+			while (slot_count < 2 * (index.names.size() + 1) + 1) slot_count *= 2;
+			index.slots.assign(slot_count, 0);
+			for (uint32_t n = 0; n < index.names.size(); ++n) {
+				uint32_t slot = index.hashes[n] & (slot_count - 1);
+				while (index.slots[slot] != 0) slot = (slot + 1) & (slot_count - 1);
+				index.slots[slot] = n + 1;
+			}
+		}
+		uint32_t mask = uint32_t(index.slots.size()) - 1;
+		uint32_t slot = hash & mask;
+		while (index.slots[slot] != 0) slot = (slot + 1) & mask;
+		index.names.emplace_back(name);
+		index.hashes.emplace_back(hash);
+		index.head.emplace_back(-1U);
+		index.tail.emplace_back(-1U);
+		index.slots[slot] = uint32_t(index.names.size());
+		return uint32_t(index.names.size() - 1);
+	};
+
+	uint32_t first_new_name = uint32_t(index.names.size());
+	uint32_t t_index = 0;
+	for (auto t = begin; t != transforms.end(); ++t) {
+		uint32_t hash = (hashes ? hashes[t_index] : SceneFormat::name_hash(t->name));
+		uint32_t n = find_name(t->name, hash);
+		if (n == -1U && hashes) {
+			//(a precomputed hash is only trusted once it has been checked against the name)
+			uint32_t actual = SceneFormat::name_hash(t->name);
+			if (actual != hash) {
+				hash = actual;
+				n = find_name(t->name, hash);
+			}
+		}
+		if (n == -1U) n = intern(t->name, hash);
+
+		uint32_t e = index.free_entries;
+		if (e != -1U) {
+			index.free_entries = index.entries[e].next;
+		} else {
+			e = uint32_t(index.entries.size());
+			index.entries.emplace_back();
+		}
+		index.entries[e].transform = const_cast< Transform * >(&*t);
+		index.entries[e].next = -1U;
+		if (index.tail[n] == -1U) index.head[n] = e;
+		else index.entries[index.tail[n]].next = e;
+		index.tail[n] = e;
+
+		index.count += 1;
+		++t_index;
+	}
+
+	//merge new names into the sorted order:
+	auto by_name = [&index](uint32_t a, uint32_t b) {
+		return index.names[a] < index.names[b];
+	};
+	size_t old_sorted = index.sorted.size();
+	for (uint32_t n = first_new_name; n < index.names.size(); ++n) {
+		index.sorted.emplace_back(n);
+	}
+	std::sort(index.sorted.begin() + old_sorted, index.sorted.end(), by_name);
+	std::inplace_merge(index.sorted.begin(), index.sorted.begin() + old_sorted, index.sorted.end(), by_name);
+}
+
+uint32_t Scene::find_name(std::string const &name, uint32_t hash) const {
+	NameIndex const &index = name_index;
+	if (index.slots.empty()) return -1U;
+	uint32_t mask = uint32_t(index.slots.size()) - 1;
+	for (uint32_t slot = hash & mask; index.slots[slot] != 0; slot = (slot + 1) & mask) {
+		uint32_t n = index.slots[slot] - 1;
+		if (index.hashes[n] == hash && index.names[n] == name) return n;
+	}
+	return -1U;
+}
+
+Scene::Transform *Scene::find(std::string const &name) const {
+	if (!name_index.valid) build_name_index();
+
+	uint32_t n = find_name(name, SceneFormat::name_hash(name));
+	if (n == -1U || name_index.head[n] == -1U) return nullptr;
+	Transform *found = name_index.entries[name_index.head[n]].transform;
+	assert(found->name == name && "name index is stale; call build_name_index() after renaming transforms");
+	return found;
+}
+
+std::vector< Scene::Transform * > Scene::find_prefix(std::string const &prefix) const {
+	if (!name_index.valid) build_name_index();
+
+	auto has_prefix = [&prefix](std::string const &name) {
+		return name.compare(0, prefix.size(), prefix) == 0;
+	};
+
+	//names with a given prefix are contiguous in sorted order:
+	std::vector< Transform * > ret;
+	NameIndex const &index = name_index;
+	auto begin = std::lower_bound(index.sorted.begin(), index.sorted.end(), prefix, [&index](uint32_t n, std::string const &p) {
+		return index.names[n] < p;
+	});
+	for (auto at = begin; at != index.sorted.end() && has_prefix(index.names[*at]); ++at) {
+		for (uint32_t e = index.head[*at]; e != -1U; e = index.entries[e].next) {
+			ret.emplace_back(index.entries[e].transform);
+		}
 	}
+	return ret;
 }
@@ -11,17 +11,24 @@
  */
 
 #include "GL.hpp"
+#include "Mesh.hpp"
+#include "ComponentStore.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <list>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+struct OcclusionBuffer; //see OcclusionBuffer.hpp
+struct TransformStore; //see TransformStore.hpp
+struct WorkerPool; //see WorkerPool.hpp
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
@@ -35,13 +42,79 @@ struct Scene {
 		//The transform above may be relative to some parent transform:
 		Transform *parent = nullptr;
 
+		//Disabling a transform hides everything attached to it or its descendants (draw() skips their drawables and lights):
+		bool enabled = true;
+		//is this transform and every ancestor enabled?
+		bool enabled_in_hierarchy() const {
+			for (Transform const *t = this; t; t = t->parent) {
+				if (!t->enabled) return false;
+			}
+			return true;
+		}
+		//...the same answer, kept in the world cache (see below), so it is only recomputed when something changed:
+		bool cached_enabled_in_hierarchy() const;
+
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (these are cached -- see 'WorldCache' below -- so repeated calls are cheap)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
+		// ..for transforming normals to the world (inverse transpose of local_to_world):
+		glm::mat3 make_normal_to_world() const;
+
+		//World-space matrices are cached. Queries always see the current hierarchy: they bring each ancestor's
+		// cache up to date (root first), then this one, where a cache is recomputed only if its transform's
+		// position/rotation/scale/parent/enabled changed or its parent's cache was recomputed since.
+		// So a query costs one comparison per ancestor when nothing has changed;
+		// Scene::update_world_caches() (once per frame, before drawing) refreshes everything in one pass instead,
+		// and passes that query many transforms while nothing moves (like draw()) check each ancestor once
+		// with update_world_cache(check).
+		//world_to_local and normal_to_world are only computed when first asked for after a change.
+		//NOTE: the cache is updated from const functions, so don't query world matrices
+		// of transforms with shared ancestors from multiple threads at once.
+		struct WorldCache {
+			//values the cache was computed from:
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			bool enabled = true;
+			uint32_t parent_generation = 0; //parent's generation when computed
+			uint32_t generation = 0; //incremented every time the cache is recomputed
+			uint32_t check = 0; //most recent update_world_cache(check) that brought this cache up to date
+			bool valid = false;
+			bool world_to_local_valid = false; //(lazily computed matrices)
+			bool normal_to_world_valid = false;
+
+			//cached values:
+			bool enabled_in_hierarchy = true;
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+			glm::mat3 normal_to_world = glm::mat3(1.0f);
+		};
+		mutable WorldCache world_cache;
+		//bring ancestors' caches up to date, then recompute world_cache.local_to_world from this transform and
+		// its parent's cache if dirty:
+		void update_world_cache() const;
+		//...same, but transforms already brought up to date during 'check' (from Scene::new_world_check()) are
+		// trusted, so a pass over many transforms checks each shared ancestor once:
+		// (only while no transform changes -- start a new check after moving anything)
+		void update_world_cache(uint32_t check) const;
+		//world_cache.normal_to_world, computing it if needed (for a cache that has been brought up to date):
+		glm::mat3 const &cached_normal_to_world() const;
+		//...same, but trusts that the parent's cache is current (as in Scene::update_world_caches):
+		void update_world_cache_from_parent() const;
+		//(helpers for the above) has anything the cache was computed from changed? / store a recomputed local_to_world:
+		bool world_cache_dirty() const;
+		void set_world_cache(glm::mat4x3 const &local_to_world) const;
+
+		//scratch space used to number transforms by list position instead of through a map:
+		// (by Scene::set, on the *source* scene, and by update_world_caches(WorkerPool &);
+		//  so don't copy from or update one scene on several threads at once)
+		mutable uint32_t copy_index = -1U;
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
@@ -52,9 +125,21 @@ struct Scene {
 	struct Drawable {
 		//a 'Drawable' attaches attribute data to a transform:
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
+		//(only the fields that culling reads every frame are stored here -- the Pipeline is kept in a side array,
+		// see Scene::pipeline() -- so a pass over the drawables array touches as few cache lines as possible)
 		Transform * transform;
 
+		//draw() skips disabled drawables, and drawables on none of the layers it is drawing:
+		bool enabled = true;
+		uint32_t layers = 1; //bitmask of render layers this drawable is on (default: layer 0 only)
+
+		//Local-space bounding box of the drawn vertices, used for view-frustum culling:
+		// (the default, empty, box means "unknown" -- such drawables are never culled)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
+		// (stored apart from the drawable; use Scene::pipeline(drawable) to get at it)
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
 
@@ -70,6 +155,13 @@ struct Scene {
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
+			//(alternatively) programs may read per-object matrices from the scene's object buffer (see Scene::ObjectData);
+			// draw() then sets only the object's index per draw, and the WORLD_TO_* uniforms once per program:
+			GLuint OBJECT_INDEX_int = -1U; //uniform location for index of this drawable's data in the object buffer
+			GLuint WORLD_TO_CLIP_mat4 = -1U; //uniform location for world to clip space matrix
+			GLuint WORLD_TO_LIGHT_mat4x3 = -1U; //uniform location for world to light space matrix
+			GLuint WORLD_NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for world normal to light space matrix
+
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
 			//texture objects to bind for the first TextureCount textures:
@@ -78,7 +170,49 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
-		} pipeline;
+
+			//(optional) instanced version of this pipeline:
+			// drawables that share program, vao, textures, and vertex range -- and have no set_uniforms function --
+			// are drawn together with a single glDrawArraysInstanced call using these:
+			struct Instanced {
+				GLuint program = 0; //instanced shader program; reads per-instance data as Scene::Instance attributes
+				GLuint vao = 0; //vertex array with per-instance attributes (see MeshBuffer::make_vao_for_program)
+				GLuint instance_buffer = 0; //buffer that 'vao' reads per-instance attributes from; filled by draw()
+
+				GLuint WORLD_TO_CLIP_mat4 = -1U; //uniform location for world to clip space matrix
+				GLuint WORLD_TO_LIGHT_mat4x3 = -1U; //uniform location for world to light space matrix
+				GLuint WORLD_NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for world normal to light space matrix
+				GLuint LIGHT_INDICES_vec4 = -1U; //uniform location for the batch's light list (vec4[2]; see ObjectData::lights)
+			} instanced;
+		};
+	};
+
+	//Per-instance data uploaded for instanced drawing (layout shared with MeshBuffer's instanced vaos):
+	using Instance = MeshInstance;
+
+	//Per-object data in the object buffer, which programs read as a samplerBuffer of RGBA32F texels:
+	// (matrices are stored as rows so that each fits in vec4s; shaders transform with dot products)
+	struct ObjectData {
+		glm::vec4 object_to_world[3]; //rows of object_to_world
+		glm::vec4 normal_to_world[3]; //rows of normal_to_world (w unused)
+		glm::vec4 lights[2]; //indices of (up to) MaxObjectLights lights in the light buffer, padded with -1
+	};
+	static_assert(sizeof(ObjectData) == 8*4*4, "ObjectData is eight texels.");
+
+	//Per-light data in the light buffer (in light space), also read as RGBA32F texels:
+	struct LightData {
+		glm::vec4 position_type; //xyz: position; w: type (0 = point, 1 = hemisphere, 2 = spot, 3 = directional)
+		glm::vec4 direction_cutoff; //xyz: direction light points; w: cosine of spot cone half-angle
+		glm::vec4 energy; //rgb: energy (a unused)
+	};
+	static_assert(sizeof(LightData) == 3*4*4, "LightData is three texels.");
+
+	enum : uint32_t {
+		//texture units the object and light buffers are bound to during draw():
+		ObjectBufferUnit = Drawable::Pipeline::TextureCount,
+		LightBufferUnit = ObjectBufferUnit + 1,
+		//each drawable is lit by (at most) this many of the scene's lights:
+		MaxObjectLights = 8,
 	};
 
 	struct Camera {
@@ -91,6 +225,7 @@ struct Scene {
 		float fovy = glm::radians(60.0f); //vertical fov (in radians)
 		float aspect = 1.0f; //x / y
 		float near = 0.01f; //near plane
+		uint32_t layers = -1U; //bitmask of render layers this camera draws (see Drawable::layers)
 		//computed from the above:
 		glm::mat4 make_projection() const;
 	};
@@ -117,16 +252,188 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
+	// transforms live in a list, so pointers to them (e.g., Drawable::transform) stay valid as the scene changes;
+	// drawables, cameras, and lights are packed into arrays (see ComponentStore.hpp), so pointers to them
+	// are only valid until components of the same type are added or removed -- keep a Handle if you need longer
+	// (after adding or removing transforms directly, call invalidate_name_index() -- see find() below)
 	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	ComponentStore< Drawable, Drawable::Pipeline > drawables; //(pipelines are the drawables' cold data)
+	ComponentStore< Camera > cameras;
+	ComponentStore< Light > lights;
+
+	//a drawable's pipeline (program, vertex array and range, uniforms, textures):
+	// (valid as long as the drawable is; references are only valid until drawables are added)
+	// copies of a scene share pipelines until either one asks for a non-const pipeline() -- see set() below
+	Drawable::Pipeline &pipeline(Drawable const &drawable) { return drawables.cold(drawable); }
+	Drawable::Pipeline const &pipeline(Drawable const &drawable) const { return drawables.cold(drawable); }
+
+	//'transforms' is kept in topological order (parents before children) -- load() and set() produce it,
+	// and adding new transforms at the end keeps it -- so world matrices can be computed in one forward sweep.
+	//Assigning Transform::parent directly can break this order; reparent() maintains it:
+	// (moves 'transform' and its descendants to just after 'new_parent' if needed; pointers remain valid)
+	// throws if new_parent is 'transform' or one of its descendants, or either isn't in this scene
+	void reparent(Transform *transform, Transform *new_parent);
+
+	//Prefabs: clone the subtree under 'prefab_root' (transforms, and the drawables, cameras, and lights attached to them)
+	// as a child of 'parent' (or as a root, if parent is null), returning the clone of prefab_root:
+	// transforms are cloned in one forward sweep and spliced onto the end of the list in bulk, and attached objects
+	// are appended to their (pre-reserved) arrays;
+	// cloned drawables share their source's pipeline (program, vertex array, textures), so they batch together.
+	// (clones are added to the name index; clone transforms reuse list nodes from 'transform_pool' before allocating)
+	Transform *instantiate(Transform const *prefab_root, Transform *parent = nullptr,
+		std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+	//...'count' clones at once, returning their roots:
+	// (each call makes a pass over the whole scene to find the subtree, so spawn many instances with one call)
+	std::vector< Transform * > instantiate(Transform const *prefab_root, Transform *parent, uint32_t count);
+
+	//remove 'root' and its descendants, along with their drawables, cameras, and lights:
+	// (pointers to removed objects become invalid; removed transforms are taken out of the name index
+	//  and moved to 'transform_pool' for instantiate() to reuse)
+	void remove(Transform *root);
+	//...remove several subtrees with one pass over the scene:
+	// (throws, without removing anything, if any root isn't in this scene)
+	void remove(std::vector< Transform * > const &roots);
+
+	//spare list nodes for instantiate() and load(), so spawning and removing prefabs (or streaming cells)
+	// doesn't allocate:
+	// (not part of the scene -- nothing else looks at these, and they aren't copied with it)
+	std::list< Transform > transform_pool;
+	//make sure at least 'count' spare transforms are pooled (e.g., before spawning many prefabs):
+	void reserve_transforms(size_t count);
+	//helper: move a pooled transform (reset to defaults) onto the end of 'to', or add a new one if the pool is empty:
+	Transform &append_transform(std::list< Transform > *to);
+	//helper for instantiate(): clone the subtree under 'prefab_root' 'count' times;
+	// subtree gets the cloned transforms (in 'transforms' order), and clones[c * subtree->size() + i] is the c'th clone of (*subtree)[i]
+	void clone_subtree(Transform const *prefab_root, Transform *parent, uint32_t count,
+		std::vector< Transform const * > *subtree, std::vector< Transform * > *clones);
+
+	//is 'transforms' in topological order?
+	bool in_topological_order() const;
+
+	//bring every transform's world matrix cache up to date in one forward pass over 'transforms':
+	// (in topological order, each parent is already current when its children are reached,
+	//  so each transform is computed from its parent's cache without looking further up)
+	//Call once per frame after moving things and before draw().
+	void update_world_caches() const;
+	//...same result, with the matrix math done in SSE batches and split across 'pool' level by level:
+	// (transforms are mirrored into 'world_store' each call; see TransformStore::mirror)
+	void update_world_caches(WorkerPool &pool) const;
+	mutable std::unique_ptr< TransformStore > world_store;
+	//a number for Transform::update_world_cache(check) that no earlier check used (on any scene):
+	static uint32_t new_world_check();
+
+	//Flatten static hierarchy (e.g., right after load -- see flatten_on_load): fold transforms that nothing refers to
+	// into their children, so parent chains -- and the matrix multiplies in make_local_to_world -- get shorter.
+	//A transform is folded away if it is enabled and has children, and neither it nor any of its children has
+	// drawables, cameras, or lights attached or is 'referenced' (by default, a transform is referenced if it has a name);
+	// code that looks transforms up by name or moves them should pass a 'referenced' function that returns true for those.
+	// (children are checked too because folding rewrites their local position/rotation/scale, which anything
+	//  attached to or moving them would see)
+	//Each child's local transform absorbs the folded one, which only happens when the combination is still
+	// a position/rotation/scale matching the original matrices within 'tolerance' (so, e.g., a non-uniformly
+	// scaled parent of rotated children is kept).
+	//Folded transforms are removed (so pointers to them, and earlier snapshots, become invalid) and their list nodes
+	// moved to 'transform_pool', as remove() does; the name index is rebuilt if it was built.
+	struct FlattenStats {
+		uint32_t folded = 0; //transforms removed
+		uint32_t depth_before = 0; //length of the longest parent chain (a root alone has depth 1)
+		uint32_t depth_after = 0;
+	};
+	FlattenStats flatten(std::function< bool(Transform const &) > const &referenced = nullptr, float tolerance = 1.0e-5f);
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
+	// (only drawables on at least one of camera.layers are drawn)
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	// (and, optionally, only some render layers)
+	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f), uint32_t layers = -1U) const;
+
+	//(optional) occlusion culling: if set, draw() also skips drawables hidden behind the buffer's occluders
+	// (the buffer is only used when it was last rendered with the same world_to_clip that draw() is using):
+	OcclusionBuffer const *occlusion = nullptr;
+
+	//counts from the most recent draw() call, useful for performance monitoring:
+	struct DrawStats {
+		uint32_t drawn = 0; //drawables sent to OpenGL
+		uint32_t hidden = 0; //drawables skipped because they (or an ancestor transform) were disabled or not on a drawn layer
+		uint32_t culled = 0; //drawables skipped because their bounds were outside the view frustum
+		uint32_t occluded = 0; //drawables skipped because their bounds were hidden in the occlusion buffer
+		uint32_t state_changes = 0; //program, vertex array, and texture binds actually issued
+		uint32_t naive_state_changes = 0; //binds that drawing each drawable independently would have issued
+		uint32_t instanced_batches = 0; //glDrawArraysInstanced calls
+		uint32_t instanced_drawables = 0; //drawables drawn as part of those calls
+		uint32_t objects_uploaded = 0; //object buffer entries re-uploaded because their matrices changed
+		uint32_t object_uploads = 0; //glBufferSubData calls made to upload them
+		uint32_t lights = 0; //lights uploaded to the light buffer
+		uint32_t light_assignments = 0; //sum over drawn objects (and instanced batches) of lights in their lists
+	};
+	mutable DrawStats draw_stats;
+
+	//draw() submits drawables from a compiled draw list sorted by (program, vertex array, textures, depth)
+	// -- so draw order is *not* the order of the drawables list.
+	//The list is rebuilt automatically when drawables are added or removed;
+	// call invalidate_draw_list() after otherwise adding/removing drawables or changing a drawable's program, vao, or textures:
+	void invalidate_draw_list();
+
+	//draw list internals:
+	struct DrawItem {
+		uint64_t key = 0; //sort key; see DrawKey* constants
+		Drawable const *drawable = nullptr;
+		Drawable::Pipeline const *pipeline = nullptr; //(stays put until drawables are added, which recompiles the list)
+		glm::mat4x3 object_to_world = glm::mat4x3(1.0f); //(draw_queue only)
+		glm::mat4 object_to_clip = glm::mat4(1.0f); //(draw_queue only)
+		bool batched = false; //(draw_queue only) drawn as part of an instanced batch
+		uint32_t object_index = -1U; //entry in the object buffer, for pipelines with OBJECT_INDEX_int set
+		glm::vec4 bounds = glm::vec4(0.0f); //(draw_queue only) world-space bounding sphere (xyz: center, w: radius)
+	};
+	//key layout, most-significant first: program rank, vao rank, texture-set rank, depth:
+	enum : uint64_t {
+		DrawKeyDepthBits = 20,
+		DrawKeyTexturesShift = DrawKeyDepthBits, DrawKeyTexturesMask = (1ULL << 16) - 1,
+		DrawKeyVAOShift = DrawKeyTexturesShift + 16, DrawKeyVAOMask = (1ULL << 12) - 1,
+		DrawKeyProgramShift = DrawKeyVAOShift + 12, DrawKeyProgramMask = (1ULL << 16) - 1,
+	};
+	mutable std::vector< DrawItem > draw_list; //state keys for every drawable with a program and vao
+	mutable std::vector< DrawItem > draw_queue; //visible drawables this frame, sorted by key
+	mutable std::vector< uint32_t > instance_queue; //indices into draw_queue of drawables that could be instanced
+	mutable std::vector< Instance > instance_data; //per-instance data for the batch being drawn
+	mutable uint32_t draw_list_version = 0; //drawables.version when draw_list was compiled
+	mutable bool draw_list_dirty = true;
+	void compile_draw_list() const;
+
+	//object buffer internals:
+	// object_data mirrors the buffer's contents, so only entries that differ from it need uploading
+	mutable std::vector< ObjectData > object_data;
+	mutable std::vector< std::pair< uint32_t, uint32_t > > object_dirty; //[begin,end) ranges of object_data to upload
+	//what each object_data entry was computed from, so entries whose transform's world cache (and the lights) haven't changed skip the recompute:
+	struct ObjectSource {
+		Transform const *transform = nullptr;
+		uint32_t generation = 0; //transform->world_cache.generation when computed
+		glm::vec4 bounds = glm::vec4(0.0f);
+		uint32_t light_count = 0; //lights picked
+	};
+	mutable std::vector< ObjectSource > object_sources;
+	mutable GLuint object_buffer = 0; //GL_TEXTURE_BUFFER storage for object_data
+	mutable GLuint object_buffer_texture = 0; //texture view of object_buffer
+
+	//light buffer internals:
+	// rebuilt every draw() call from 'lights'; light_bins holds the world-space data used to pick each drawable's lights
+	struct LightBin {
+		Light::Type type = Light::Point;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+		float half_fov = 0.0f; //(spot lights only) cone half-angle, in radians
+		float strength = 0.0f; //brightest channel of energy
+	};
+	mutable std::vector< LightData > light_data;
+	mutable std::vector< LightBin > light_bins;
+	mutable std::vector< LightBin > previous_light_bins; //light_bins from the previous draw() call (light picks are reused only if they match)
+	mutable std::vector< std::pair< float, uint32_t > > light_candidates; //scratch space for light selection
+	mutable GLuint light_buffer = 0; //GL_TEXTURE_BUFFER storage for light_data
+	mutable GLuint light_buffer_texture = 0; //texture view of light_buffer
+	//write indices of the lights most relevant to a world-space sphere into 'lights', returning how many:
+	uint32_t pick_lights(glm::vec4 const &bounds, glm::vec4 lights[2]) const;
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -135,19 +442,105 @@ struct Scene {
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
 
+	//flatten the transforms load() adds (after load_extra has seen them), as flatten(flatten_referenced) would,
+	// leaving transforms that were already in the scene alone: (off by default, since it erases transforms)
+	bool flatten_on_load = false;
+	std::function< bool(Transform const &) > flatten_referenced;
+	FlattenStats load_flatten_stats; //from the most recent load() with flatten_on_load set
+
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
-	Scene() = default;
+	// (defined in Scene.cpp, where TransformStore -- held by world_store -- is a complete type)
+	Scene();
+	//(frees the object and light buffers, if draw() made them)
+	virtual ~Scene();
 
 	//load a scene:
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
 	//copy a scene (with proper pointer fixup):
+	// existing list nodes and arrays are reused, so copying over a scene that was itself copied from the same source
+	// (e.g., to reset a level) allocates nothing and leaves pointers to its transforms and drawables valid;
+	// cached world matrices are copied too, so only transforms changed after the copy are recomputed;
+	// drawable pipelines aren't copied at all: the copy shares them with the source until either scene adds or
+	// removes drawables or asks for a non-const pipeline(), which clones them (copy-on-write -- see ComponentStore.hpp)
+	// throws if a parent, drawable, camera, light, or name index entry points to a transform outside the source scene
+	// (the destination is left partly copied)
+	//Transforms, drawables, cameras, and lights themselves are still copied, since game code writes their fields
+	// through plain pointers, which gives no place to notice a write (they are small; pipelines are most of a drawable)
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//Snapshots store the position/rotation/scale of every transform (in 'transforms' order) in one array:
+	// (so a reparent() that reorders transforms invalidates earlier snapshots)
+	// much cheaper than copying the whole scene when only transforms need to be put back
+	// (the hierarchy, names, drawables, cameras, and lights are not part of a snapshot)
+	struct Snapshot {
+		struct TransformState {
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+		};
+		static_assert(sizeof(TransformState) == 4*3 + 4*4 + 4*3, "TransformState is packed.");
+		std::vector< TransformState > transforms;
+
+		//save/load as a "snp0" chunk (see read_write_chunk.hpp); load throws on format errors:
+		void save(std::ostream *to) const;
+		void load(std::istream &from);
+	};
+	Snapshot snapshot() const;
+	//put transforms back as they were when 'snapshot' was taken:
+	// throws if the scene has a different number of transforms than when the snapshot was taken
+	void restore(Snapshot const &snapshot);
+
+	//Look up transforms by name:
+	// (uses the name index, which load(), instantiate(), remove(), set(), and flatten() keep up to date;
+	//  after adding, removing, or renaming transforms any other way -- e.g., editing 'transforms' directly --
+	//  call build_name_index() or invalidate_name_index(), since lookups can't detect such changes)
+	//first transform (in the order it was indexed, which is 'transforms' order unless reparent() moved it) with a given name, or nullptr if there is none:
+	Transform *find(std::string const &name) const;
+	//all transforms whose names start with 'prefix', sorted by name:
+	std::vector< Transform * > find_prefix(std::string const &prefix) const;
+
+	//(re-)build the name index over all transforms:
+	// if 'hashes' is given, hashes[i] is SceneFormat::name_hash of the i'th transform's name
+	void build_name_index(uint32_t const *hashes = nullptr) const;
+	//mark the name index out of date, so the next lookup rebuilds it (cheaper than build_name_index() when
+	// making many direct changes):
+	void invalidate_name_index();
+	//add the transforms from 'begin' to the end of 'transforms' (which were appended after the index was last
+	// up to date) to the name index; hashes, if given, are for those transforms only:
+	// (precomputed hashes are checked the first time each name is seen, and wrong ones are recomputed;
+	//  if the index isn't valid, it is rebuilt over all transforms instead)
+	void index_names(std::list< Transform >::const_iterator begin, uint32_t const *hashes = nullptr) const;
+
+	//name index internals:
+	// unique names are interned once; 'slots' is an open-addressing hash table of name ids;
+	// transforms with each name are kept in a singly-linked list of entries, so transforms can be added without a rebuild
+	struct NameIndex {
+		std::vector< std::string > names; //interned names
+		std::vector< uint32_t > hashes; //hash of each interned name
+		std::vector< uint32_t > slots; //name id + 1, or 0 for empty; size is a power of two, at least twice names.size()
+		std::vector< uint32_t > head; //first entry with each name id, or -1U if none
+		std::vector< uint32_t > tail; //last entry with each name id, or -1U if none
+		struct Entry {
+			Transform *transform = nullptr;
+			uint32_t next = -1U; //next entry with the same name, or -1U
+		};
+		std::vector< Entry > entries;
+		uint32_t free_entries = -1U; //first entry unlinked by remove() (chained through 'next'), reused before appending
+		std::vector< uint32_t > sorted; //name ids in lexicographic order of names, for prefix queries
+		size_t count = 0; //transforms indexed
+		//set by build_name_index() and kept by Scene functions that add or remove transforms; when false, the
+		// entries may point to transforms that no longer exist, so nothing but a rebuild may read them:
+		bool valid = false;
+	};
+	mutable NameIndex name_index;
+	//helper: id of an interned name (or -1U):
+	uint32_t find_name(std::string const &name, uint32_t hash) const;
 };
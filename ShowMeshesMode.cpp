@@ -22,12 +22,13 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene.drawables.emplace_back(&scene.transforms.back());
 		scene_drawable = &scene.drawables.back();
 
-		scene_drawable->pipeline = show_meshes_program_pipeline;
-		scene_drawable->pipeline.vao = vao;
+		Scene::Drawable::Pipeline &pipeline = scene.pipeline(*scene_drawable);
+		pipeline = show_meshes_program_pipeline;
+		pipeline.vao = vao;
 		//these will be updated by the mesh selection code:
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		pipeline.type = GL_TRIANGLES;
+		pipeline.start = 0;
+		pipeline.count = 0;
 	}
 
 	//select first mesh in buffer:
@@ -120,6 +121,7 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
+	scene.update_world_caches();
 	scene.draw(*scene_camera);
 
 	{ //decorate with some lines:
@@ -156,18 +158,19 @@ void ShowMeshesMode::select_prev_mesh() {
 	if (f != buffer.meshes.end()) --f;
 	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
 
+	Scene::Drawable::Pipeline &pipeline = scene.pipeline(*scene_drawable);
 	if (f != buffer.meshes.end()) {
 		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
+		pipeline.type = f->second.type;
+		pipeline.start = f->second.start;
+		pipeline.count = f->second.count;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
 	} else {
 		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		pipeline.type = GL_TRIANGLES;
+		pipeline.start = 0;
+		pipeline.count = 0;
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -185,18 +188,19 @@ void ShowMeshesMode::select_next_mesh() {
 		}
 	}
 
+	Scene::Drawable::Pipeline &pipeline = scene.pipeline(*scene_drawable);
 	if (f != buffer.meshes.end()) {
 		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
+		pipeline.type = f->second.type;
+		pipeline.start = f->second.start;
+		pipeline.count = f->second.count;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
 	} else {
 		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		pipeline.type = GL_TRIANGLES;
+		pipeline.start = 0;
+		pipeline.count = 0;
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -5,6 +5,12 @@
 #include <SDL.h>
 
 #include <list>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
 #include <cassert>
 #include <exception>
 #include <iostream>
@@ -20,9 +26,54 @@ namespace {
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
+	//Number of samples mixed per call of mix_audio (MIX_SAMPLES unless set by Sound::init_headless):
+	uint32_t mix_samples = MIX_SAMPLES;
+
+	//In headless mode there is no device; the caller runs the mixer with Sound::mix()
+	// and Sound::lock()/unlock() use the chosen lock instead of the device lock:
+	bool headless = false;
+	Sound::LockStrategy lock_strategy = Sound::LockStrategy::Mutex;
+	std::mutex headless_mutex;
+	std::atomic_flag headless_spin = ATOMIC_FLAG_INIT;
+
 	//list of all currently playing samples:
 	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
 
+	//Recorder copies the final mix into a single-producer/single-consumer ring buffer
+	// from the audio callback; a background thread drains the ring to a '.wav' file:
+	struct Recorder {
+		Recorder(std::string const &filename);
+		~Recorder();
+
+		//called from the audio callback -- never blocks or allocates:
+		void push(float const *data, uint32_t count);
+
+		//ring buffer of interleaved (l,r) float samples; size is a power of two:
+		static constexpr uint32_t RingSize = 1 << 20; //~10 seconds of stereo audio
+		std::vector< float > ring;
+		std::atomic< uint64_t > write_pos{0}; //only written by push()
+		std::atomic< uint64_t > read_pos{0}; //only written by writer thread
+		std::atomic< uint64_t > dropped{0}; //samples dropped because the ring was full
+
+		std::ofstream file;
+		std::string filename;
+		uint64_t data_bytes = 0; //bytes of sample data written so far
+
+		std::atomic< bool > quit{false};
+		std::thread writer;
+		void write_loop();
+	};
+
+	//Latency measurements, written by mix_audio and read while holding Sound::lock():
+	struct LatencyLog {
+		static constexpr uint32_t Capacity = 4096; //only the most recent measurements are kept
+		std::array< float, Capacity > to_mix; //seconds from play() to the start of the block that first mixed the sample
+		uint32_t count = 0; //total measurements taken (wraps around the arrays)
+	} latency_log;
+
+	//currently active recorder (if any); only changed while holding Sound::lock():
+	Recorder *recorder = nullptr;
+
 }
 
 //public-facing data:
@@ -33,6 +84,9 @@ Sound::Ramp< float > Sound::volume = Sound::Ramp< float >(1.0f);
 //global listener information:
 Sound::Listener Sound::listener;
 
+//print latency statistics from shutdown():
+bool Sound::report_latency_at_shutdown = false;
+
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
@@ -82,21 +136,113 @@ void Sound::init() {
 
 
 void Sound::shutdown() {
+	stop_recording();
+
+	if (report_latency_at_shutdown && latency_log.count) report_latency();
+
 	if (device != 0) {
 		//stop audio playback:
 		SDL_PauseAudioDevice(device, 1);
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+
+	if (headless) {
+		playing_samples.clear();
+		headless = false;
+		mix_samples = MIX_SAMPLES;
+	}
+}
+
+void Sound::init_headless(uint32_t samples, LockStrategy strategy) {
+	if (device != 0 || headless) {
+		throw std::runtime_error("Sound::init_headless() called while audio is already initialized.");
+	}
+	if (samples == 0) {
+		throw std::runtime_error("Sound::init_headless() needs a nonzero block size.");
+	}
+	headless = true;
+	mix_samples = samples;
+	lock_strategy = strategy;
+	latency_log.count = 0;
+}
+
+uint32_t Sound::block_samples() {
+	return mix_samples;
+}
+
+void Sound::mix(float *buffer) {
+	assert(headless && "Sound::mix() is only for headless mode");
+	lock();
+	mix_audio(nullptr, reinterpret_cast< Uint8 * >(buffer), int(mix_samples * 2 * sizeof(float)));
+	unlock();
 }
 
 
+void Sound::start_recording(std::string const &filename) {
+	stop_recording();
+	Recorder *new_recorder = new Recorder(filename); //may throw
+	lock();
+	recorder = new_recorder;
+	unlock();
+	std::cout << "Recording audio to '" << filename << "'." << std::endl;
+}
+
+void Sound::stop_recording() {
+	lock();
+	Recorder *old_recorder = recorder;
+	recorder = nullptr;
+	unlock();
+	if (old_recorder) {
+		std::string filename = old_recorder->filename;
+		delete old_recorder; //drains remaining samples and finishes the file
+		std::cout << "Finished recording audio to '" << filename << "'." << std::endl;
+	}
+}
+
+bool Sound::is_recording() {
+	return recorder != nullptr;
+}
+
+void Sound::report_latency() {
+	lock();
+	uint32_t count = std::min(latency_log.count, LatencyLog::Capacity);
+	std::vector< float > to_mix(latency_log.to_mix.begin(), latency_log.to_mix.begin() + count);
+	unlock();
+
+	if (count == 0) {
+		std::cout << "Audio latency: no samples measured." << std::endl;
+		return;
+	}
+
+	std::sort(to_mix.begin(), to_mix.end());
+	auto at = [&to_mix](float t) { return 1000.0f * to_mix[std::min(to_mix.size() - 1, size_t(t * to_mix.size()))]; };
+	std::cout << "Audio latency (play() to mix) over " << count << " samples with a " << mix_samples << "-sample mix:"
+		<< " min " << at(0.0f) << "ms, median " << at(0.5f) << "ms, 95% " << at(0.95f) << "ms, max " << at(1.0f) << "ms" << std::endl;
+}
+
 void Sound::lock() {
-	if (device) SDL_LockAudioDevice(device);
+	if (device) {
+		SDL_LockAudioDevice(device);
+	} else if (headless) {
+		if (lock_strategy == LockStrategy::Mutex) {
+			headless_mutex.lock();
+		} else {
+			while (headless_spin.test_and_set(std::memory_order_acquire)) { }
+		}
+	}
 }
 
 void Sound::unlock() {
-	if (device) SDL_UnlockAudioDevice(device);
+	if (device) {
+		SDL_UnlockAudioDevice(device);
+	} else if (headless) {
+		if (lock_strategy == LockStrategy::Mutex) {
+			headless_mutex.unlock();
+		} else {
+			headless_spin.clear(std::memory_order_release);
+		}
+	}
 }
 
 std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
@@ -207,6 +353,113 @@ void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec
 
 //------------------------ internals --------------------------------
 
+//helper: write a little-endian value to a stream:
+template< typename T >
+void write_le(std::ostream &to, T value) {
+	static_assert(std::is_integral< T >::value, "write_le only handles integers");
+	for (uint32_t b = 0; b < sizeof(T); ++b) {
+		to.put(char((uint64_t(value) >> (8 * b)) & 0xff));
+	}
+}
+
+//helper: write the header of a 48kHz stereo float '.wav' file with a given data size:
+// (non-PCM formats get the extended 18-byte 'fmt ' chunk and a 'fact' chunk, which some readers require)
+void write_wav_header(std::ostream &to, uint32_t data_bytes) {
+	to.write("RIFF", 4);
+	write_le< uint32_t >(to, 4 + (8 + 18) + (8 + 4) + (8 + data_bytes));
+	to.write("WAVE", 4);
+
+	to.write("fmt ", 4);
+	write_le< uint32_t >(to, 18);
+	write_le< uint16_t >(to, 3); //WAVE_FORMAT_IEEE_FLOAT
+	write_le< uint16_t >(to, 2); //channels
+	write_le< uint32_t >(to, AUDIO_RATE);
+	write_le< uint32_t >(to, AUDIO_RATE * 2 * sizeof(float)); //bytes per second
+	write_le< uint16_t >(to, 2 * sizeof(float)); //bytes per frame
+	write_le< uint16_t >(to, 8 * sizeof(float)); //bits per sample
+	write_le< uint16_t >(to, 0); //cbSize (no extension)
+
+	to.write("fact", 4);
+	write_le< uint32_t >(to, 4);
+	write_le< uint32_t >(to, data_bytes / (2 * sizeof(float))); //sample frames
+
+	to.write("data", 4);
+	write_le< uint32_t >(to, data_bytes);
+}
+
+Recorder::Recorder(std::string const &filename_) : ring(RingSize, 0.0f), filename(filename_) {
+	file.open(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "' for recording.");
+	}
+	//sizes get patched when recording finishes:
+	write_wav_header(file, 0);
+
+	writer = std::thread(&Recorder::write_loop, this);
+}
+
+Recorder::~Recorder() {
+	quit = true;
+	writer.join();
+
+	//patch sizes in header now that the length is known:
+	// (the header size fields are 32-bit, so very long recordings will have a clamped size)
+	uint32_t clamped_bytes = uint32_t(std::min< uint64_t >(data_bytes, 0xffffffffu - (4 + (8 + 18) + (8 + 4) + 8)));
+	file.seekp(0);
+	write_wav_header(file, clamped_bytes);
+	file.close();
+
+	if (dropped) {
+		std::cerr << "WARNING: recording '" << filename << "' dropped " << dropped << " samples because the writer fell behind." << std::endl;
+	}
+}
+
+void Recorder::push(float const *data, uint32_t count) {
+	uint64_t write = write_pos.load(std::memory_order_relaxed);
+	uint64_t read = read_pos.load(std::memory_order_acquire);
+	if (RingSize - (write - read) < count) {
+		dropped.fetch_add(count, std::memory_order_relaxed);
+		return;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		ring[(write + i) & (RingSize - 1)] = data[i];
+	}
+	write_pos.store(write + count, std::memory_order_release);
+}
+
+void Recorder::write_loop() {
+	//samples are collected into a large staging buffer so file writes happen in big blocks:
+	std::vector< float > staging;
+	staging.reserve(RingSize / 4);
+
+	auto flush = [&]() {
+		file.write(reinterpret_cast< char const * >(staging.data()), staging.size() * sizeof(float));
+		data_bytes += staging.size() * sizeof(float);
+		staging.clear();
+	};
+
+	while (true) {
+		//read 'quit' before draining so the last samples pushed before quit are never lost:
+		bool finishing = quit.load();
+
+		uint64_t read = read_pos.load(std::memory_order_relaxed);
+		uint64_t write = write_pos.load(std::memory_order_acquire);
+		while (read < write) {
+			uint32_t count = uint32_t(std::min< uint64_t >(write - read, staging.capacity() - staging.size()));
+			for (uint32_t i = 0; i < count; ++i) {
+				staging.emplace_back(ring[(read + i) & (RingSize - 1)]);
+			}
+			read += count;
+			read_pos.store(read, std::memory_order_release);
+			if (staging.size() == staging.capacity()) flush();
+		}
+
+		if (finishing) break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	flush();
+}
+
 
 //helper: equal-power panning
 inline void compute_pan_weights(float pan, float *left, float *right) {
@@ -251,11 +504,14 @@ void compute_pan_from_listener_and_position(
 	}
 }
 
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: ramp updates (by the time covered by one mixed block)...
+inline float ramp_step() {
+	return float(mix_samples) / float(AUDIO_RATE);
+}
 
 //helper: ...for single values:
 void step_value_ramp(Sound::Ramp< float > &ramp) {
+	float const RAMP_STEP = ramp_step();
 	if (ramp.ramp < RAMP_STEP) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
@@ -267,6 +523,7 @@ void step_value_ramp(Sound::Ramp< float > &ramp) {
 
 //helper: ...for 3D positions:
 void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
+	float const RAMP_STEP = ramp_step();
 	if (ramp.ramp < RAMP_STEP) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
@@ -278,6 +535,7 @@ void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 
 //helper: ...for 3D directions:
 void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
+	float const RAMP_STEP = ramp_step();
 	if (ramp.ramp < RAMP_STEP) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
@@ -319,15 +577,18 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	assert(len == int(mix_samples * sizeof(LR))); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
 
+	//time at which this block is being mixed, for latency measurement:
+	auto block_time = std::chrono::high_resolution_clock::now();
+
 	//update global values:
 	float start_volume = Sound::volume.value;
 	glm::vec3 start_position =  Sound::listener.position.value;
@@ -345,6 +606,15 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
 		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
 
+		//record latency the first time a sample is mixed:
+		if (!playing_sample.mixed) {
+			playing_sample.mixed = true;
+			float to_mix = std::chrono::duration< float >(block_time - playing_sample.requested).count();
+			uint32_t slot = latency_log.count % LatencyLog::Capacity;
+			latency_log.to_mix[slot] = to_mix;
+			latency_log.count += 1;
+		}
+
 		//Figure out sample panning/volume at start...
 		LR start_pan;
 		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
@@ -388,12 +658,12 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
 		LR pan = start_pan;
 		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+		pan_step.l = (end_pan.l - start_pan.l) / mix_samples;
+		pan_step.r = (end_pan.r - start_pan.r) / mix_samples;
 
 		assert(playing_sample.i < playing_sample.data.size());
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+		for (uint32_t i = 0; i < mix_samples; ++i) {
 			//mix one sample based on current pan values:
 			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
 			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
@@ -425,9 +695,14 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		}
 	}
 
+	//pass the final mix along to the recorder (if one is running):
+	if (recorder) {
+		recorder->push(reinterpret_cast< float const * >(buffer), mix_samples * 2);
+	}
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
 	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
@@ -6,6 +6,7 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <chrono>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
@@ -81,6 +82,10 @@ struct PlayingSample {
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
 	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
 
+	//latency instrumentation: when playback was requested and whether the mixer has reached it yet:
+	std::chrono::high_resolution_clock::time_point requested = std::chrono::high_resolution_clock::now();
+	bool mixed = false;
+
 	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
 		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
 	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
@@ -140,6 +145,30 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//record the final mix to a (48kHz, stereo, 32-bit float) '.wav' file:
+// the audio callback only copies into a ring buffer; a background thread does the file writes.
+// start_recording throws if the file can't be opened.
+void start_recording(std::string const &filename);
+void stop_recording();
+bool is_recording();
+
+//print statistics about the delay from play() to the start of the first block that mixes the sample:
+// (SDL2 doesn't report the device's playback position, so time to actual output isn't measured)
+void report_latency();
+//if set, Sound::shutdown() calls report_latency() when any samples were played (main.cpp sets this from '--audio-latency'):
+extern bool report_latency_at_shutdown;
+
+//headless mode, for measuring the mixer without an audio device (see sound-latency.cpp):
+// call init_headless() instead of init(), then call mix() to run the mixer once per block of 'samples'.
+// lock()/unlock() then use the given strategy to guard the mixer against play(), set_*(), etc.
+enum class LockStrategy {
+	Mutex, //std::mutex (as SDL's device lock is)
+	Spin, //busy-wait on an atomic flag
+};
+void init_headless(uint32_t samples, LockStrategy strategy); //throws if audio is already initialized
+uint32_t block_samples(); //samples mixed per block
+void mix(float *buffer); //mix one block of interleaved stereo samples (2 * block_samples() floats)
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
 // the set_*/stop/play/... functions already use these helpers, so you shouldn't need
 // to call them unless your code is modifying values directly:
@@ -0,0 +1,347 @@
+#include "TransformStore.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+TransformStore::Handle TransformStore::add(Handle parent, std::string const &name) {
+	uint32_t parent_index = -1U;
+	if (parent != Handle()) {
+		if (!valid(parent)) throw std::runtime_error("TransformStore::add given invalid parent handle.");
+		parent_index = index(parent);
+	}
+
+	uint32_t slot;
+	if (!free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+	} else {
+		slot = uint32_t(slots.size());
+		slots.emplace_back();
+	}
+
+	//appending keeps parents-before-children order, since parent already exists:
+	uint32_t idx = size();
+	slots[slot].index = idx;
+	positions.emplace_back(0.0f);
+	rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+	scales.emplace_back(1.0f);
+	parents.emplace_back(parent_index);
+	local_to_world.emplace_back(1.0f);
+	names.emplace_back(name);
+	slot_of.emplace_back(slot);
+	levels_dirty = true;
+
+	return Handle{slot, slots[slot].generation};
+}
+
+void TransformStore::remove(Handle handle) {
+	if (!valid(handle)) return;
+	uint32_t first = index(handle);
+
+	//since parents come first, descendants can be found in one forward pass:
+	std::vector< bool > removed(size() - first, false);
+	removed[0] = true;
+	for (uint32_t i = first + 1; i < size(); ++i) {
+		removed[i - first] = (parents[i] != -1U && parents[i] >= first && removed[parents[i] - first]);
+	}
+
+	//compact arrays, preserving order and remapping parent indices:
+	std::vector< uint32_t > remap(size() - first, -1U);
+	uint32_t out = first;
+	for (uint32_t i = first; i < size(); ++i) {
+		if (removed[i - first]) {
+			Slot &slot = slots[slot_of[i]];
+			slot.index = -1U;
+			slot.generation += 1;
+			free_slots.emplace_back(slot_of[i]);
+			continue;
+		}
+		remap[i - first] = out;
+		positions[out] = positions[i];
+		rotations[out] = rotations[i];
+		scales[out] = scales[i];
+		parents[out] = (parents[i] != -1U && parents[i] >= first ? remap[parents[i] - first] : parents[i]);
+		local_to_world[out] = local_to_world[i];
+		names[out] = std::move(names[i]);
+		slot_of[out] = slot_of[i];
+		slots[slot_of[out]].index = out;
+		++out;
+	}
+
+	positions.resize(out);
+	rotations.resize(out);
+	scales.resize(out);
+	parents.resize(out);
+	local_to_world.resize(out);
+	names.resize(out);
+	slot_of.resize(out);
+	levels_dirty = true;
+}
+
+bool TransformStore::valid(Handle handle) const {
+	return handle.slot < slots.size()
+	    && slots[handle.slot].generation == handle.generation
+	    && slots[handle.slot].index != -1U;
+}
+
+uint32_t TransformStore::index(Handle handle) const {
+	assert(valid(handle));
+	return slots[handle.slot].index;
+}
+
+TransformStore::Handle TransformStore::handle(uint32_t idx) const {
+	assert(idx < size());
+	uint32_t slot = slot_of[idx];
+	return Handle{slot, slots[slot].generation};
+}
+
+void TransformStore::clear() {
+	positions.clear();
+	rotations.clear();
+	scales.clear();
+	parents.clear();
+	local_to_world.clear();
+	local_to_parent.clear();
+	names.clear();
+	slots.clear();
+	free_slots.clear();
+	slot_of.clear();
+	mirrored.clear();
+	levels_dirty = true;
+}
+
+glm::mat4x3 TransformStore::make_local_to_parent(uint32_t i) const {
+	//same computation as Scene::Transform::make_local_to_parent:
+	glm::mat3 rot = glm::mat3_cast(rotations[i]);
+	return glm::mat4x3(
+		rot[0] * scales[i].x,
+		rot[1] * scales[i].y,
+		rot[2] * scales[i].z,
+		positions[i]
+	);
+}
+
+#ifdef SIMD_SSE2
+//helper: rotation matrix elements (column-major, m[c*3+r]) for four quaternions, as glm::mat3_cast computes them:
+static void rotation_elements(__m128 x, __m128 y, __m128 z, __m128 w, __m128 m[9]) {
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+	__m128 xz = _mm_mul_ps(x, z), xy = _mm_mul_ps(x, y), yz = _mm_mul_ps(y, z);
+	__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+	m[0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+	m[1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+	m[2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+	m[3] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+	m[4] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+	m[5] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+	m[6] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+	m[7] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+	m[8] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+}
+
+//helper: write twelve element vectors (e[k] holds element k of four matrices) as four mat4x3's:
+static void store_matrices(__m128 e[12], glm::mat4x3 *out) {
+	static_assert(sizeof(glm::mat4x3) == 12 * 4, "mat4x3 is twelve packed floats");
+	for (uint32_t g = 0; g < 3; ++g) {
+		__m128 r0 = e[4*g+0], r1 = e[4*g+1], r2 = e[4*g+2], r3 = e[4*g+3];
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(&out[0][0][0] + 4*g, r0);
+		_mm_storeu_ps(&out[1][0][0] + 4*g, r1);
+		_mm_storeu_ps(&out[2][0][0] + 4*g, r2);
+		_mm_storeu_ps(&out[3][0][0] + 4*g, r3);
+	}
+}
+#endif
+
+void TransformStore::make_local_matrices(uint32_t count,
+	glm::vec3 const *positions_, glm::quat const *rotations_, glm::vec3 const *scales_,
+	glm::mat4x3 *local_to_parent_) {
+	assert(local_to_parent_);
+
+	uint32_t i = 0;
+#ifdef SIMD_SSE2
+	for (; i + 4 <= count; i += 4) {
+		//gather four transforms into one lane each:
+		auto lanes = [i](auto const &get) {
+			return _mm_setr_ps(get(i), get(i+1), get(i+2), get(i+3));
+		};
+		__m128 p[3], s[3];
+		for (uint32_t c = 0; c < 3; ++c) {
+			p[c] = lanes([&](uint32_t j) { return positions_[j][c]; });
+			s[c] = lanes([&](uint32_t j) { return scales_[j][c]; });
+		}
+		__m128 qx = lanes([&](uint32_t j) { return rotations_[j].x; });
+		__m128 qy = lanes([&](uint32_t j) { return rotations_[j].y; });
+		__m128 qz = lanes([&](uint32_t j) { return rotations_[j].z; });
+		__m128 qw = lanes([&](uint32_t j) { return rotations_[j].w; });
+
+		//translate * rotate * scale:
+		__m128 m[9];
+		rotation_elements(qx, qy, qz, qw, m);
+		__m128 e[12];
+		for (uint32_t c = 0; c < 3; ++c) {
+			for (uint32_t r = 0; r < 3; ++r) {
+				e[c*3+r] = _mm_mul_ps(m[c*3+r], s[c]);
+			}
+			e[9+c] = p[c];
+		}
+		store_matrices(e, local_to_parent_ + i);
+	}
+#endif
+	//remaining transforms (or all of them, without SSE), with the same math as Scene::Transform:
+	for (; i < count; ++i) {
+		glm::vec3 const &position = positions_[i];
+		glm::quat const &rotation = rotations_[i];
+		glm::vec3 const &scale = scales_[i];
+		glm::mat3 rot = glm::mat3_cast(rotation);
+		local_to_parent_[i] = glm::mat4x3(rot[0] * scale.x, rot[1] * scale.y, rot[2] * scale.z, position);
+	}
+}
+
+void TransformStore::update_world() {
+	local_to_parent.resize(size());
+	make_local_matrices(size(), positions.data(), rotations.data(), scales.data(), local_to_parent.data());
+
+	for (uint32_t i = 0; i < size(); ++i) {
+		if (parents[i] == -1U) {
+			local_to_world[i] = local_to_parent[i];
+		} else {
+			assert(parents[i] < i); //parents-before-children
+			local_to_world[i] = local_to_world[parents[i]] * glm::mat4(local_to_parent[i]);
+		}
+	}
+}
+
+void TransformStore::update_levels() {
+	if (!levels_dirty) return;
+
+	//depth of each transform (parents come first, so one pass suffices):
+	std::vector< uint32_t > depth(size(), 0);
+	uint32_t max_depth = 0;
+	for (uint32_t i = 0; i < size(); ++i) {
+		if (parents[i] != -1U) depth[i] = depth[parents[i]] + 1;
+		max_depth = std::max(max_depth, depth[i]);
+	}
+
+	//counting sort by depth:
+	level_begin.assign(max_depth + 2, 0);
+	for (uint32_t i = 0; i < size(); ++i) {
+		level_begin[depth[i] + 1] += 1;
+	}
+	for (uint32_t d = 1; d < level_begin.size(); ++d) {
+		level_begin[d] += level_begin[d-1];
+	}
+	level_order.resize(size());
+	std::vector< uint32_t > fill(level_begin.begin(), level_begin.end() - 1);
+	for (uint32_t i = 0; i < size(); ++i) {
+		level_order[fill[depth[i]]++] = i;
+	}
+
+	levels_dirty = false;
+}
+
+void TransformStore::update_world(WorkerPool &pool) {
+	update_levels();
+
+	//below this many transforms per level, threading overhead outweighs the work:
+	constexpr uint32_t Grain = 512;
+
+	//local matrices don't depend on the hierarchy, so can be computed for any range at once:
+	local_to_parent.resize(size());
+	pool.parallel_for(size(), Grain, [&](uint32_t begin, uint32_t end) {
+		make_local_matrices(end - begin, positions.data() + begin, rotations.data() + begin, scales.data() + begin, local_to_parent.data() + begin);
+	});
+
+	for (uint32_t d = 0; d + 1 < level_begin.size(); ++d) {
+		uint32_t const *level = level_order.data() + level_begin[d];
+		uint32_t count = level_begin[d+1] - level_begin[d];
+		//every parent is at depth d-1, so was finished by the previous level:
+		pool.parallel_for(count, Grain, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t l = begin; l < end; ++l) {
+				uint32_t i = level[l];
+				if (parents[i] == -1U) {
+					local_to_world[i] = local_to_parent[i];
+				} else {
+					local_to_world[i] = local_to_world[parents[i]] * glm::mat4(local_to_parent[i]);
+				}
+			}
+		});
+	}
+}
+
+void TransformStore::set(Scene const &scene, std::unordered_map< Scene::Transform const *, Handle > *handle_map_) {
+	std::unordered_map< Scene::Transform const *, Handle > map_temp;
+	std::unordered_map< Scene::Transform const *, Handle > &handle_map = *(handle_map_ ? handle_map_ : &map_temp);
+
+	clear();
+	handle_map.clear();
+
+	size_t count = scene.transforms.size();
+	positions.reserve(count);
+	rotations.reserve(count);
+	scales.reserve(count);
+	parents.reserve(count);
+	local_to_world.reserve(count);
+	names.reserve(count);
+	slots.reserve(count);
+	slot_of.reserve(count);
+
+	//add parents before children -- scene.transforms is normally in topological order already (see Scene::reparent),
+	// but a parent assigned directly may come later, so walk up to the nearest added ancestor with an explicit stack:
+	std::vector< Scene::Transform const * > pending;
+	for (auto const &t : scene.transforms) {
+		for (Scene::Transform const *at = &t; at && !handle_map.count(at); at = at->parent) {
+			pending.emplace_back(at);
+			if (pending.size() > count) throw std::runtime_error("TransformStore::set given a scene with a cycle in its hierarchy.");
+		}
+		while (!pending.empty()) {
+			Scene::Transform const &p = *pending.back();
+			pending.pop_back();
+			Handle h = add(p.parent ? handle_map.at(p.parent) : Handle(), p.name);
+			uint32_t i = index(h);
+			positions[i] = p.position;
+			rotations[i] = p.rotation;
+			scales[i] = p.scale;
+			handle_map.emplace(&p, h);
+		}
+	}
+}
+
+void TransformStore::mirror(Scene const &scene) {
+	uint32_t count = uint32_t(scene.transforms.size());
+	if (count != size() || !slots.empty()) {
+		clear();
+		positions.resize(count);
+		rotations.resize(count);
+		scales.resize(count);
+		parents.assign(count, -1U);
+		local_to_world.resize(count);
+		mirrored.assign(count, nullptr);
+	}
+
+	uint32_t i = 0;
+	for (auto const &t : scene.transforms) {
+		t.copy_index = i;
+		mirrored[i] = &t;
+		uint32_t parent = -1U;
+		if (t.parent) {
+			//(copy_index is only current for transforms already numbered in this pass)
+			parent = t.parent->copy_index;
+			if (!(parent < i && mirrored[parent] == t.parent)) {
+				throw std::runtime_error("TransformStore::mirror given a scene whose transforms aren't in topological order.");
+			}
+		}
+		if (parents[i] != parent) {
+			parents[i] = parent;
+			levels_dirty = true;
+		}
+		positions[i] = t.position;
+		rotations[i] = t.rotation;
+		scales[i] = t.scale;
+		++i;
+	}
+}
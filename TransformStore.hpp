@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+ * TransformStore holds a transform hierarchy as a structure of arrays:
+ *  contiguous position, rotation, scale, and parent-index arrays, always
+ *  sorted so that parents come before their children.
+ *
+ * Because of this ordering, world matrices can be computed in a single
+ *  linear pass, and copying a store is just a handful of vector copies.
+ *
+ * Transforms are addressed by Handles, which remain valid as the arrays
+ *  are compacted or reordered (until the transform is removed).
+ *
+ */
+
+#include "Handle.hpp"
+#include "Scene.hpp"
+#include "WorkerPool.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+struct TransformStore {
+	//Handles refer to transforms independent of their current array index:
+	using Handle = ::Handle;
+
+	//add a transform (as a child of 'parent', if parent is a valid handle):
+	Handle add(Handle parent = Handle(), std::string const &name = "");
+
+	//remove a transform along with all of its descendants:
+	void remove(Handle handle);
+
+	//is handle referring to a transform that still exists?
+	bool valid(Handle handle) const;
+
+	//current array index of a transform (changes when transforms are removed):
+	uint32_t index(Handle handle) const;
+	//handle of the transform at a given array index:
+	Handle handle(uint32_t index) const;
+
+	uint32_t size() const { return uint32_t(positions.size()); }
+	void clear();
+
+	//Compute local_to_world for every transform in one forward pass:
+	void update_world();
+
+	//Compute local_to_world level-by-level (all roots, then all depth-1 transforms, ...),
+	// splitting each level across the pool's threads; results match update_world() exactly:
+	void update_world(WorkerPool &pool);
+
+	//helper: local-to-parent matrix for transform at a given index (same math as Scene::Transform):
+	glm::mat4x3 make_local_to_parent(uint32_t index) const;
+
+	//batched version of Scene::Transform's make_local_to_parent over 'count' transforms:
+	// (works on four transforms at a time with SSE where available)
+	static void make_local_matrices(uint32_t count,
+		glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+		glm::mat4x3 *local_to_parent);
+
+	//Replace contents with a copy of scene's transforms:
+	// (optionally returns the Transform -> Handle mapping)
+	void set(Scene const &scene, std::unordered_map< Scene::Transform const *, Handle > *handle_map = nullptr);
+
+	//Copy position/rotation/scale of scene's transforms (which must be in topological order; throws otherwise)
+	// into the arrays, one per index in list order, updating parent indices only if the hierarchy changed:
+	// (unlike set(), makes no handles or names, so is cheap enough to call every frame -- it's for stores used
+	//  as scratch space to compute world matrices, as in Scene::update_world_caches; don't add() or remove() after)
+	void mirror(Scene const &scene);
+
+	//--- arrays (all indexed by array index; parents before children) ---
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::quat > rotations;
+	std::vector< glm::vec3 > scales;
+	std::vector< uint32_t > parents; //array index of parent, or -1U for roots
+
+	//world matrices, computed by update_world():
+	std::vector< glm::mat4x3 > local_to_world;
+	//(local matrices, computed in a batch by update_world() before the hierarchy pass)
+	std::vector< glm::mat4x3 > local_to_parent;
+
+	//rarely-accessed data is kept apart from the hot arrays above:
+	std::vector< std::string > names;
+
+	//--- internals ---
+	struct Slot {
+		uint32_t index = -1U; //array index, or -1U if slot is free
+		uint32_t generation = 0; //incremented when slot is freed
+	};
+	std::vector< Slot > slots;
+	std::vector< uint32_t > free_slots;
+	std::vector< uint32_t > slot_of; //array index -> slot
+	std::vector< Scene::Transform const * > mirrored; //(after mirror()) scene transform at each array index
+
+	//transform indices grouped by depth in the hierarchy, used by parallel update_world:
+	// (rebuilt lazily after the hierarchy changes)
+	std::vector< uint32_t > level_order; //array indices sorted by depth
+	std::vector< uint32_t > level_begin; //level_order[level_begin[d] .. level_begin[d+1]) are at depth d
+	bool levels_dirty = true;
+	void update_levels();
+};
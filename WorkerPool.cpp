@@ -0,0 +1,88 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+uint32_t WorkerPool::default_threads() {
+	uint32_t hardware = std::thread::hardware_concurrency();
+	return (hardware > 1 ? hardware - 1 : 0);
+}
+
+WorkerPool::WorkerPool(uint32_t threads) {
+	workers.reserve(threads);
+	for (uint32_t t = 0; t < threads; ++t) {
+		workers.emplace_back([this](){
+			uint32_t seen_generation = 0;
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				wake.wait(lock, [&](){ return quit || (job && job_generation != seen_generation); });
+				if (quit) return;
+				seen_generation = job_generation;
+				Job *current = job;
+				busy += 1;
+
+				lock.unlock();
+				run(*current);
+				lock.lock();
+
+				busy -= 1;
+				if (busy == 0) done.notify_all();
+			}
+		});
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void WorkerPool::run(Job &job) {
+	while (true) {
+		uint32_t chunk = job.next.fetch_add(1);
+		if (chunk >= job.chunks) break;
+		uint32_t begin = chunk * job.grain;
+		uint32_t end = std::min(job.count, begin + job.grain);
+		(*job.fn)(begin, end);
+		job.completed.fetch_add(1);
+	}
+}
+
+void WorkerPool::parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &fn) {
+	if (count == 0) return;
+	grain = std::max(grain, 1U);
+
+	//small loops (or no workers) just run on the calling thread:
+	if (count <= grain || workers.empty()) {
+		fn(0, count);
+		return;
+	}
+
+	Job local;
+	local.fn = &fn;
+	local.count = count;
+	local.grain = grain;
+	local.chunks = (count + grain - 1) / grain;
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		assert(job == nullptr && "parallel_for should not be called re-entrantly or from several threads at once.");
+		job = &local;
+		job_generation += 1;
+	}
+	wake.notify_all();
+
+	//calling thread helps out:
+	run(local);
+
+	//wait for stragglers, then retire the job so late-waking workers don't touch it:
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [&](){ return local.completed.load() == local.chunks && busy == 0; });
+	job = nullptr;
+}
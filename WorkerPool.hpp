@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ * WorkerPool keeps a set of threads around for data-parallel loops.
+ *
+ * parallel_for(count, grain, fn) calls fn(begin, end) on disjoint ranges
+ *  covering [0, count), using the pool's threads and the calling thread,
+ *  and returns once every range is done.
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct WorkerPool {
+	//create a pool with a given number of worker threads (in addition to the calling thread):
+	// (default is one fewer than the number of hardware threads)
+	WorkerPool(uint32_t threads = default_threads());
+	~WorkerPool();
+
+	//run fn over [0,count) in ranges of (at most) 'grain' elements:
+	// (fn may be called concurrently from several threads)
+	void parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &fn);
+
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	static uint32_t default_threads();
+
+	//--- internals ---
+	struct Job {
+		std::function< void(uint32_t, uint32_t) > const *fn = nullptr;
+		uint32_t count = 0;
+		uint32_t grain = 1;
+		uint32_t chunks = 0;
+		std::atomic< uint32_t > next{0}; //next chunk to claim
+		std::atomic< uint32_t > completed{0}; //chunks finished
+	};
+	static void run(Job &job);
+
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable wake; //signalled when a job is posted (or on quit)
+	std::condition_variable done; //signalled when a worker goes idle
+	Job *job = nullptr; //current job (guarded by mutex)
+	uint32_t job_generation = 0; //incremented per job (guarded by mutex)
+	uint32_t busy = 0; //workers currently running a job (guarded by mutex)
+	bool quit = false;
+};
@@ -0,0 +1,376 @@
+#include "WorldStream.hpp"
+
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+WorldStream::WorldStream(std::string const &filename_, Scene &scene_,
+	std::function< void(Scene &, Scene::Transform *, std::string const &) > const &on_drawable_,
+	uint32_t threads) : filename(filename_), scene(scene_), on_drawable(on_drawable_) {
+
+	using namespace SceneFormat;
+
+	{ //read the cell table (cell contents are read later, by the loader threads):
+		MappedFile file(filename);
+		Toc toc(file.begin(), file.end());
+
+		ChunkSpan< WorldInfo > info = toc.read< WorldInfo >("wld0");
+		if (info.size() != 1) throw std::runtime_error("Expected exactly one world info entry in '" + filename + "'.");
+		cell_size = info[0].cell_size;
+		if (!(cell_size > 0.0f)) throw std::runtime_error("World '" + filename + "' has invalid cell size.");
+
+		ChunkSpan< CellEntry > entries = toc.read< CellEntry >("cel0");
+		cells.reserve(entries.size());
+		for (auto const &entry : entries) {
+			if (entry.toc_index >= toc.entries.size() || std::memcmp(toc.entries[entry.toc_index].type, "cdat", 4) != 0) {
+				throw std::runtime_error("World '" + filename + "' contains cell entry that doesn't refer to a cdat chunk.");
+			}
+			if (!cell_index.emplace(cell_key(entry.x, entry.y), uint32_t(cells.size())).second) {
+				throw std::runtime_error("World '" + filename + "' contains more than one cell at " + std::to_string(entry.x) + "," + std::to_string(entry.y) + ".");
+			}
+			if (cells.empty()) {
+				cell_min = cell_max = glm::ivec2(entry.x, entry.y);
+			} else {
+				cell_min = glm::min(cell_min, glm::ivec2(entry.x, entry.y));
+				cell_max = glm::max(cell_max, glm::ivec2(entry.x, entry.y));
+			}
+			cells.emplace_back();
+			Cell &cell = cells.back();
+			cell.coord = glm::ivec2(entry.x, entry.y);
+			cell.offset = toc.entries[entry.toc_index].offset;
+			cell.size = toc.entries[entry.toc_index].size;
+		}
+	}
+
+	threads = std::max(threads, 1u);
+	for (uint32_t i = 0; i < threads; ++i) {
+		loaders.emplace_back(&WorldStream::load_loop, this);
+	}
+}
+
+WorldStream::~WorldStream() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &loader : loaders) {
+		loader.join();
+	}
+}
+
+void WorldStream::update(glm::vec3 const &focus) {
+	stats = Stats();
+
+	collect_finished();
+
+	//find cells within load_radius, nearest first:
+	glm::vec2 at = glm::vec2(focus.x, focus.y);
+	auto distance_to = [&](Cell const &cell) {
+		glm::vec2 min = glm::vec2(cell.coord) * cell_size;
+		glm::vec2 max = min + glm::vec2(cell_size);
+		return glm::length(glm::max(glm::vec2(0.0f), glm::max(min - at, at - max)));
+	};
+	wanted.clear();
+	//(the range of cells to check is clamped to the cells there are, in double -- a far-away or non-finite
+	// focus, or a huge load_radius, could be beyond what int32_t holds)
+	bool any = !cells.empty() && std::isfinite(at.x) && std::isfinite(at.y);
+	glm::ivec2 lo = cell_min;
+	glm::ivec2 hi = cell_max;
+	for (uint32_t axis = 0; axis < 2 && any; ++axis) {
+		double l = std::floor((double(at[axis]) - double(load_radius)) / double(cell_size));
+		double h = std::floor((double(at[axis]) + double(load_radius)) / double(cell_size));
+		if (!(l <= double(cell_max[axis]) && h >= double(cell_min[axis]))) {
+			any = false;
+		} else {
+			if (l > double(lo[axis])) lo[axis] = int32_t(l);
+			if (h < double(hi[axis])) hi[axis] = int32_t(h);
+		}
+	}
+	for (int64_t y = lo.y; any && y <= hi.y; ++y) {
+		for (int64_t x = lo.x; x <= hi.x; ++x) {
+			auto f = cell_index.find(cell_key(int32_t(x), int32_t(y)));
+			if (f == cell_index.end()) continue;
+			Cell &cell = cells[f->second];
+			cell.distance = distance_to(cell);
+			if (cell.distance <= load_radius) wanted.emplace_back(f->second);
+		}
+	}
+	std::sort(wanted.begin(), wanted.end(), [this](uint32_t a, uint32_t b) {
+		return cells[a].distance < cells[b].distance;
+	});
+
+	//re-queue: cells still waiting in the queue go back to unloaded, then unloaded wanted cells are queued nearest first:
+	// (cells a loader has already started on stay 'Loading' and are collected when done)
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		for (uint32_t index : queue) {
+			cells[index].state = Cell::Unloaded;
+		}
+		queue.clear();
+		for (uint32_t index : wanted) {
+			Cell &cell = cells[index];
+			if (cell.state != Cell::Unloaded) continue;
+			cell.state = Cell::Loading;
+			queue.emplace_back(index);
+		}
+		stats.queued = uint32_t(queue.size());
+	}
+	stats.failed = failed_cells;
+	wake.notify_all();
+
+	//attach parsed cells, nearest first, until the budget runs out:
+	uint32_t budget = attach_budget;
+	for (uint32_t index : wanted) {
+		Cell &cell = cells[index];
+		if (cell.state != Cell::Ready) continue;
+		uint32_t count = uint32_t(cell.data->hierarchy.size()) + 1; //(+1 for the cell root)
+		if (stats.attached > 0 && count > budget) break;
+		attach(cell);
+		budget -= std::min(budget, count);
+		stats.attached += 1;
+		stats.attached_transforms += count;
+	}
+
+	//evict loaded cells outside load_radius, farthest first, while over the memory budget:
+	size_t bytes = 0;
+	for (uint32_t index : resident) {
+		bytes += cells[index].bytes;
+	}
+	if (bytes > memory_budget) {
+		for (uint32_t index : resident) {
+			cells[index].distance = distance_to(cells[index]);
+		}
+		std::sort(resident.begin(), resident.end(), [this](uint32_t a, uint32_t b) {
+			return cells[a].distance > cells[b].distance;
+		});
+		for (uint32_t index : resident) {
+			if (bytes <= memory_budget) break;
+			Cell &cell = cells[index];
+			if (cell.distance <= load_radius) break; //(everything after this is nearer)
+			bytes -= cell.bytes;
+			evict(cell);
+			stats.evicted += 1;
+		}
+		resident.erase(std::remove_if(resident.begin(), resident.end(), [this](uint32_t index) {
+			return cells[index].state == Cell::Unloaded;
+		}), resident.end());
+	}
+	stats.resident = uint32_t(resident.size());
+	stats.resident_bytes = bytes;
+}
+
+void WorldStream::finish(glm::vec3 const &focus) {
+	uint32_t old_budget = attach_budget;
+	attach_budget = -1U;
+	try {
+		while (true) {
+			update(focus);
+			bool done = std::all_of(wanted.begin(), wanted.end(), [this](uint32_t index) {
+				return cells[index].state == Cell::Attached || cells[index].state == Cell::Failed;
+			});
+			if (done) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	} catch (...) {
+		attach_budget = old_budget;
+		throw;
+	}
+	attach_budget = old_budget;
+}
+
+void WorldStream::collect_finished() {
+	std::vector< Finished > results;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		results.swap(finished);
+	}
+
+	for (auto &result : results) {
+		Cell &cell = cells[result.cell];
+		assert(cell.state == Cell::Loading);
+		if (!result.data) {
+			//(the file won't change, so trying again would only fail again)
+			cell.state = Cell::Failed;
+			failed_cells += 1;
+			std::cerr << "WARNING: failed to load cell " << cell.coord.x << "," << cell.coord.y << " of '" << filename << "': " << result.error << std::endl;
+			continue;
+		}
+		//(cells that are no longer wanted are kept parsed until evicted, in case they are wanted again)
+		cell.data = std::move(result.data);
+		cell.bytes = cell.data->bytes;
+		cell.state = Cell::Ready;
+		resident.emplace_back(result.cell);
+	}
+}
+
+void WorldStream::attach(Cell &cell) {
+	assert(cell.state == Cell::Ready && cell.data);
+	CellData const &data = *cell.data;
+
+	//cell contents hang from a root transform, so they can be removed together:
+	cell.root = &scene.append_transform(&scene.transforms);
+	cell.root->name = "cell " + std::to_string(cell.coord.x) + "," + std::to_string(cell.coord.y);
+	auto first = std::prev(scene.transforms.end());
+
+	std::vector< Scene::Transform * > hierarchy_transforms;
+	hierarchy_transforms.reserve(data.hierarchy.size());
+	for (uint32_t i = 0; i < data.hierarchy.size(); ++i) {
+		SceneFormat::HierarchyEntry const &h = data.hierarchy[i];
+		Scene::Transform *t = &scene.append_transform(&scene.transforms);
+		t->parent = (h.parent == -1U ? cell.root : hierarchy_transforms[h.parent]);
+		t->name = data.transform_names[i];
+		t->position = h.position;
+		t->rotation = h.rotation;
+		t->scale = h.scale;
+		hierarchy_transforms.emplace_back(t);
+	}
+
+	//add the cell's transforms to the name index (before on_drawable, which might add more transforms of its own):
+	{
+		std::vector< uint32_t > hashes;
+		hashes.reserve(data.name_hashes.size() + 1);
+		hashes.emplace_back(SceneFormat::name_hash(cell.root->name));
+		hashes.insert(hashes.end(), data.name_hashes.begin(), data.name_hashes.end());
+		scene.index_names(first, hashes.data());
+	}
+
+	if (on_drawable) {
+		for (uint32_t i = 0; i < data.mesh_names.size(); ++i) {
+			on_drawable(scene, hierarchy_transforms[data.mesh_transforms[i]], data.mesh_names[i]);
+		}
+	}
+
+	for (auto const &l : data.lights) {
+		Scene::Light &light = scene.lights.emplace_back(hierarchy_transforms[l.transform]);
+		light.type = static_cast< Scene::Light::Type >(l.type);
+		light.energy = glm::vec3(l.color) / 255.0f * l.energy;
+		light.spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
+	}
+
+	cell.data.reset();
+	cell.state = Cell::Attached;
+}
+
+void WorldStream::evict(Cell &cell) {
+	assert(cell.state == Cell::Ready || cell.state == Cell::Attached);
+	if (cell.state == Cell::Attached) {
+		scene.remove(cell.root);
+		cell.root = nullptr;
+	}
+	cell.data.reset();
+	cell.bytes = 0;
+	cell.state = Cell::Unloaded;
+}
+
+void WorldStream::load_loop() {
+	std::ifstream file(filename, std::ios::binary);
+
+	//cells are read into whole blocks of PayloadAlignment bytes, so they are aligned as SceneFormat::Toc requires:
+	struct alignas(SceneFormat::PayloadAlignment) Block {
+		char bytes[SceneFormat::PayloadAlignment];
+	};
+	std::vector< Block > buffer;
+
+	while (true) {
+		uint32_t index;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			wake.wait(lock, [this]() { return quit || !queue.empty(); });
+			if (quit) return;
+			index = queue.front();
+			queue.pop_front();
+		}
+
+		//(a cell's offset and size never change after construction, so they can be read without the lock)
+		Cell const &cell = cells[index];
+		Finished result;
+		result.cell = index;
+		try {
+			if (!file.is_open()) throw std::runtime_error("failed to open file");
+			buffer.resize((size_t(cell.size) + sizeof(Block) - 1) / sizeof(Block));
+			char *data = reinterpret_cast< char * >(buffer.data());
+			file.clear();
+			file.seekg(cell.offset);
+			if (!file.read(data, cell.size)) throw std::runtime_error("failed to read cell data");
+			result.data = parse_cell(data, data + cell.size);
+		} catch (std::exception const &e) {
+			result.data.reset();
+			result.error = e.what();
+		}
+
+		std::unique_lock< std::mutex > lock(mutex);
+		finished.emplace_back(std::move(result));
+	}
+}
+
+std::unique_ptr< WorldStream::CellData > WorldStream::parse_cell(char const *begin, char const *end) {
+	using namespace SceneFormat;
+	Toc toc(begin, end);
+	ChunkSpan< char > names = toc.read< char >("str0");
+	ChunkSpan< HierarchyEntry > hierarchy = toc.read< HierarchyEntry >("xfh0");
+	ChunkSpan< MeshEntry > meshes = toc.read< MeshEntry >("msh0");
+	ChunkSpan< LightEntry > lights = toc.read< LightEntry >("lmp0");
+	ChunkSpan< uint32_t > name_hashes = toc.read_optional< uint32_t >("nhs0");
+
+	auto name = [&names](uint32_t name_begin, uint32_t name_end) {
+		if (!(name_begin <= name_end && name_end <= names.size())) {
+			throw std::runtime_error("cell contains entry with invalid name indices");
+		}
+		return std::string(names.begin() + name_begin, names.begin() + name_end);
+	};
+
+	std::unique_ptr< CellData > data(new CellData);
+
+	data->hierarchy.assign(hierarchy.begin(), hierarchy.end());
+	data->transform_names.reserve(hierarchy.size());
+	for (uint32_t i = 0; i < hierarchy.size(); ++i) {
+		if (hierarchy[i].parent != -1U && hierarchy[i].parent >= i) {
+			throw std::runtime_error("cell did not contain transforms in topological-sort order");
+		}
+		data->transform_names.emplace_back(name(hierarchy[i].name_begin, hierarchy[i].name_end));
+	}
+	//(Scene::index_names checks these against the names, so a wrong hash in the file is harmless)
+	if (name_hashes.size() == hierarchy.size()) {
+		data->name_hashes.assign(name_hashes.begin(), name_hashes.end());
+	} else {
+		data->name_hashes.reserve(hierarchy.size());
+		for (auto const &n : data->transform_names) {
+			data->name_hashes.emplace_back(SceneFormat::name_hash(n));
+		}
+	}
+
+	data->mesh_transforms.reserve(meshes.size());
+	data->mesh_names.reserve(meshes.size());
+	for (auto const &m : meshes) {
+		if (m.transform >= hierarchy.size()) {
+			throw std::runtime_error("cell contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+		}
+		data->mesh_transforms.emplace_back(m.transform);
+		data->mesh_names.emplace_back(name(m.name_begin, m.name_end));
+	}
+
+	for (auto const &l : lights) {
+		if (l.transform >= hierarchy.size()) {
+			throw std::runtime_error("cell contains lamp entry with invalid transform index (" + std::to_string(l.transform) + ")");
+		}
+		//(unrecognized lamp types are skipped, as Scene::load does)
+		if (l.type != 'p' && l.type != 'h' && l.type != 's' && l.type != 'd') continue;
+		data->lights.emplace_back(l);
+	}
+
+	data->bytes = sizeof(CellData) + names.size()
+		+ hierarchy.size() * (sizeof(Scene::Transform) + sizeof(uint32_t))
+		+ meshes.size() * (sizeof(Scene::Drawable) + sizeof(Scene::Drawable::Pipeline))
+		+ data->lights.size() * sizeof(Scene::Light);
+
+	return data;
+}
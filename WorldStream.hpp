@@ -0,0 +1,149 @@
+#pragma once
+
+/*
+ * WorldStream streams a large world into a Scene one cell at a time,
+ *  instead of loading everything up front with Scene::load.
+ *
+ * A world file (see scene_format.hpp; made with scenes/split-world) divides
+ *  a scene into square cells in the xy plane, each stored as its own chunk.
+ *  Each call to update(focus):
+ *   - queues unloaded cells within load_radius of 'focus' for loading, nearest first
+ *     (queued cells that are no longer wanted are dropped from the queue);
+ *   - collects cells that background threads have read and parsed;
+ *   - attaches parsed cells to the scene, nearest first, stopping once attach_budget
+ *     transforms have been added -- attaching calls on_drawable, which is where
+ *     GL state for new drawables gets set up, so this bounds per-frame GL work;
+ *   - if loaded cells take more than memory_budget bytes, evicts cells outside
+ *     load_radius, farthest first.
+ *
+ * Each attached cell's transforms are parented to a cell root transform
+ *  (named "cell x,y"), so evicting a cell is just Scene::remove of that root.
+ *  Pointers to a cell's transforms, drawables, and lights become invalid when it
+ *  is evicted. Attaching a cell adds its transforms to the scene's name index
+ *  (with name hashes from the world file, or computed by the loader threads),
+ *  and evicting it takes them out again, so Scene::find never has to rebuild it.
+ *
+ * A cell that fails to load is reported (on std::cerr) once, and is never retried.
+ *
+ * Cells still attached when the stream is destroyed stay in the scene.
+ *
+ */
+
+#include "Scene.hpp"
+#include "scene_format.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct WorldStream {
+	//open a world file (throws on error) and start 'threads' background loaders:
+	// on_drawable is called (from update()) for each mesh entry in attached cells, as with Scene::load
+	WorldStream(std::string const &filename_, Scene &scene_,
+		std::function< void(Scene &, Scene::Transform *, std::string const &) > const &on_drawable_,
+		uint32_t threads = 2);
+	~WorldStream();
+
+	//loader threads refer to the stream, so it can't be copied:
+	WorldStream(WorldStream const &) = delete;
+	WorldStream &operator=(WorldStream const &) = delete;
+
+	//streaming parameters (may be changed between updates):
+	float load_radius = 100.0f; //cells at least partly within this distance (in the xy plane) of the focus are loaded
+	size_t memory_budget = size_t(64) << 20; //bytes of loaded cells to allow before evicting cells outside load_radius
+	uint32_t attach_budget = 2000; //transforms to attach per update (at least one cell is attached, whatever its size)
+
+	//stream cells around 'focus' (call once per frame, from the thread that owns the GL context):
+	// (a non-finite focus wants no cells)
+	void update(glm::vec3 const &focus);
+
+	//load every cell within load_radius of 'focus' before returning, ignoring attach_budget:
+	// (e.g., while a loading screen is up; cells that fail to load are skipped)
+	void finish(glm::vec3 const &focus);
+
+	//counts from the most recent update(), useful for performance monitoring:
+	struct Stats {
+		uint32_t queued = 0; //cells waiting for (or being read by) a loader thread
+		uint32_t attached = 0; //cells attached to the scene this update
+		uint32_t attached_transforms = 0; //...and the transforms they added
+		uint32_t evicted = 0; //cells evicted this update
+		uint32_t resident = 0; //cells loaded (parsed or attached) after this update
+		size_t resident_bytes = 0; //estimated memory used by those cells
+		uint32_t failed = 0; //cells that have failed to load (ever)
+	};
+	Stats stats;
+
+	std::string filename;
+	Scene &scene;
+	std::function< void(Scene &, Scene::Transform *, std::string const &) > on_drawable;
+	float cell_size = 1.0f;
+
+	//--- internals ---
+
+	//cell contents, parsed by a loader thread and ready to attach:
+	struct CellData {
+		std::vector< SceneFormat::HierarchyEntry > hierarchy; //(name indices unused; see transform_names)
+		std::vector< std::string > transform_names;
+		std::vector< uint32_t > name_hashes; //SceneFormat::name_hash of each transform name
+		std::vector< uint32_t > mesh_transforms; //index into hierarchy for each mesh
+		std::vector< std::string > mesh_names;
+		std::vector< SceneFormat::LightEntry > lights;
+		size_t bytes = 0; //estimated memory once attached
+	};
+	//parse a cell's cdat payload (must be PayloadAlignment-aligned in memory; throws on error):
+	static std::unique_ptr< CellData > parse_cell(char const *begin, char const *end);
+
+	struct Cell {
+		glm::ivec2 coord = glm::ivec2(0);
+		uint32_t offset = 0; //location of cdat chunk in the file
+		uint32_t size = 0;
+		enum State {
+			Unloaded,
+			Loading, //in 'queue' or being read by a loader thread
+			Ready, //parsed; 'data' is set
+			Attached, //in the scene under 'root'
+			Failed, //couldn't be loaded; reported once and never queued again
+		} state = Unloaded;
+		std::unique_ptr< CellData > data;
+		Scene::Transform *root = nullptr;
+		size_t bytes = 0; //estimated memory while Ready or Attached
+		float distance = 0.0f; //from the most recent focus
+	};
+	std::vector< Cell > cells;
+	std::unordered_map< uint64_t, uint32_t > cell_index; //cell_key(coord) -> index in cells
+	glm::ivec2 cell_min = glm::ivec2(0), cell_max = glm::ivec2(-1); //bounds of cells' coordinates (min > max if there are none)
+	uint32_t failed_cells = 0;
+	static uint64_t cell_key(int32_t x, int32_t y) {
+		return (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(y));
+	}
+
+	std::vector< uint32_t > resident; //indices of Ready and Attached cells
+	std::vector< uint32_t > wanted; //(scratch) cells within load_radius, nearest first
+
+	void attach(Cell &cell);
+	void evict(Cell &cell);
+	void collect_finished();
+
+	//loader threads:
+	struct Finished {
+		uint32_t cell;
+		std::unique_ptr< CellData > data; //nullptr on error
+		std::string error;
+	};
+	std::mutex mutex;
+	std::condition_variable wake; //signalled when cells are queued (or on quit)
+	std::deque< uint32_t > queue; //cells to load, nearest first (guarded by mutex)
+	std::vector< Finished > finished; //loaded cells not yet collected by update() (guarded by mutex)
+	bool quit = false; //(guarded by mutex)
+	std::vector< std::thread > loaders;
+	void load_loop();
+};
@@ -0,0 +1,179 @@
+//animation-test checks AnimationClip compression and file I/O, and times clip playback:
+//  - compress() of smooth and sharp position, rotation, and scale tracks keeps few keys, and playback
+//    through AnimationPlayer stays within the requested tolerance (plus quantization) of every sample;
+//  - save() then load() reproduces the clip exactly, and a truncated file is rejected;
+//  - apply() over many bound transforms is timed.
+//
+// usage: animation-test [scratch file] [transforms]
+//
+// The scratch file (default: animation-test.anim in the current directory) is removed afterward.
+
+#include "Animation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [scratch file] [transforms]\nTests animation clip compression and playback." << std::endl;
+		return 1;
+	}
+	std::string scratch = (argc > 1 ? argv[1] : "animation-test.anim");
+	uint32_t count = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 1000);
+
+	constexpr float FrameRate = 30.0f;
+	constexpr uint32_t Frames = 300;
+	constexpr float Tolerance = 1.0e-3f;
+
+	//sampled tracks for 'count' transforms:
+	// position: a slow orbit (smooth) with a hop every 50 frames (sharp);
+	// rotation: a spin about a tilted axis; scale: constant (so one key each end should do)
+	std::vector< AnimationClip::Samples > samples;
+	for (uint32_t t = 0; t < count; ++t) {
+		std::string name = "t" + std::to_string(t);
+		float phase = 0.01f * float(t);
+		AnimationClip::Samples position{name, AnimationClip::Position, {}};
+		AnimationClip::Samples rotation{name, AnimationClip::Rotation, {}};
+		AnimationClip::Samples scale{name, AnimationClip::Scale, {}};
+		for (uint32_t f = 0; f < Frames; ++f) {
+			float time = float(f) / FrameRate;
+			float hop = ((f / 50) % 2 ? 1.0f : 0.0f);
+			position.values.emplace_back(5.0f * std::cos(time + phase), 5.0f * std::sin(time + phase), hop, 0.0f);
+			glm::quat q = glm::angleAxis(2.0f * time + phase, glm::normalize(glm::vec3(0.2f, 0.1f, 1.0f)));
+			rotation.values.emplace_back(q.x, q.y, q.z, q.w);
+			scale.values.emplace_back(1.5f, 1.5f, 1.5f, 0.0f);
+		}
+		samples.emplace_back(position);
+		samples.emplace_back(rotation);
+		samples.emplace_back(scale);
+	}
+
+	auto ms_since = [](std::chrono::steady_clock::time_point before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count();
+	};
+
+	bool ok = true;
+	auto fail = [&ok](std::string const &message) {
+		std::cout << "ERROR: " << message << std::endl;
+		ok = false;
+	};
+
+	AnimationClip clip;
+	{
+		auto before = std::chrono::steady_clock::now();
+		clip = AnimationClip::compress(FrameRate, samples, Tolerance);
+		std::cout << count << " transforms, " << Frames << " frames: compress() " << ms_since(before) << "ms; "
+			<< clip.key_frames.size() << " keys kept of " << samples.size() * Frames << " samples." << std::endl;
+	}
+	if (clip.frames != Frames || clip.tracks.size() != samples.size()) fail("compressed clip has the wrong shape.");
+	for (auto const &track : clip.tracks) {
+		if (track.channel == AnimationClip::Scale && track.key_end - track.key_begin != 2) fail("constant track '" + track.name + "' kept more than two keys.");
+	}
+
+	//play back every frame and compare to the samples:
+	// (keys themselves are off by up to half a quantization step, which can exceed the tolerance on wide tracks)
+	Scene scene;
+	for (uint32_t t = 0; t < count; ++t) {
+		scene.transforms.emplace_back();
+		scene.transforms.back().name = "t" + std::to_string(t);
+	}
+	{
+		AnimationPlayer player(clip, scene);
+		player.loop = false;
+		float max_error[3] = {0.0f, 0.0f, 0.0f};
+		bool over = false;
+		for (uint32_t f = 0; f < Frames; ++f) {
+			player.time = float(f) / FrameRate;
+			player.apply();
+			uint32_t t = 0;
+			for (auto const &transform : scene.transforms) {
+				glm::vec4 got[3] = {
+					glm::vec4(transform.position, 0.0f),
+					glm::vec4(transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w),
+					glm::vec4(transform.scale, 0.0f),
+				};
+				for (uint32_t c = 0; c < 3; ++c) {
+					AnimationClip::Track const &track = clip.tracks[3 * t + c];
+					glm::vec4 want = samples[3 * t + c].values[f];
+					float error = 0.0f;
+					for (uint32_t i = 0; i < 4; ++i) {
+						float e = std::abs(got[c][i] - want[i]);
+						if (c == AnimationClip::Rotation) e = std::min(e, std::abs(got[c][i] + want[i])); //(q and -q are the same rotation)
+						error = std::max(error, e);
+					}
+					max_error[c] = std::max(max_error[c], error);
+					float half_step = 0.5f * std::max(std::max(track.step.x, track.step.y), std::max(track.step.z, track.step.w));
+					if (error > Tolerance + half_step + 1.0e-5f) over = true;
+				}
+				++t;
+			}
+		}
+		std::cout << "  max playback error: position " << max_error[0] << ", rotation " << max_error[1] << ", scale " << max_error[2]
+			<< " (tolerance " << Tolerance << ")" << std::endl;
+		if (over) fail("playback strayed from the samples by more than the tolerance.");
+	}
+
+	//file round trip:
+	{
+		std::ofstream out(scratch, std::ios::binary);
+		clip.save(&out);
+	}
+	{
+		AnimationClip loaded(scratch);
+		bool same = loaded.frame_rate == clip.frame_rate && loaded.frames == clip.frames
+			&& loaded.key_frames == clip.key_frames && loaded.key_values == clip.key_values
+			&& loaded.tracks.size() == clip.tracks.size();
+		for (uint32_t i = 0; same && i < clip.tracks.size(); ++i) {
+			AnimationClip::Track const &a = clip.tracks[i];
+			AnimationClip::Track const &b = loaded.tracks[i];
+			same = a.name == b.name && a.channel == b.channel && a.key_begin == b.key_begin && a.key_end == b.key_end
+				&& a.base == b.base && a.step == b.step;
+		}
+		if (!same) fail("loaded clip differs from the saved one.");
+	}
+	{
+		//drop the last few bytes, cutting into the final chunk:
+		std::vector< char > data;
+		{
+			std::ifstream in(scratch, std::ios::binary);
+			data.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+		}
+		data.resize(data.size() - 6);
+		{
+			std::ofstream out(scratch, std::ios::binary);
+			out.write(data.data(), data.size());
+		}
+		bool threw = false;
+		try {
+			AnimationClip truncated(scratch);
+		} catch (std::runtime_error &) {
+			threw = true;
+		}
+		if (!threw) fail("truncated clip file was loaded without error.");
+	}
+	std::remove(scratch.c_str());
+
+	//playback speed:
+	{
+		AnimationPlayer player(clip, scene);
+		std::vector< float > ms;
+		for (uint32_t f = 0; f < Frames; ++f) {
+			player.advance(1.0f / 60.0f);
+			auto before = std::chrono::steady_clock::now();
+			player.apply();
+			ms.emplace_back(ms_since(before));
+		}
+		std::sort(ms.begin(), ms.end());
+		std::cout << "  apply() for " << 3 * count << " tracks: min " << ms[0] << "ms, median " << ms[ms.size() / 2] << "ms" << std::endl;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+//bvh-bench times DrawableBVH over a large synthetic scene of boxes:
+//  - build() and refit() (after moving a tenth of the objects, and some of the groups they are parented to);
+//  - ray, box, sphere, and frustum queries;
+// and checks every query against a brute-force test of every drawable.
+//
+// usage: bvh-bench [objects] [queries]
+//
+// Some of the rays are axis-aligned and start exactly on box faces, which is where a careless
+// slab test produces NaNs.
+
+#include "DrawableBVH.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [objects] [queries]\nTimes DrawableBVH builds, refits, and queries." << std::endl;
+		return 1;
+	}
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000);
+	uint32_t queries = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 1000);
+
+	//unit boxes scattered through a cube, on integer coordinates (so axis-aligned rays can start on their faces),
+	// parented to groups (which are only ever translated by whole units, so the boxes stay axis-aligned unit cubes):
+	constexpr float Extent = 500.0f;
+	constexpr uint32_t Groups = 64;
+	std::mt19937 mt(0xb0c5);
+	std::uniform_int_distribution< int > coord(-int(Extent), int(Extent));
+	Scene scene;
+	std::vector< Scene::Transform * > groups;
+	for (uint32_t g = 0; g < Groups; ++g) {
+		scene.transforms.emplace_back();
+		groups.emplace_back(&scene.transforms.back());
+	}
+	scene.drawables.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		scene.transforms.emplace_back();
+		Scene::Transform &t = scene.transforms.back();
+		t.parent = groups[i % Groups];
+		t.position = glm::vec3(float(coord(mt)), float(coord(mt)), float(coord(mt)));
+		Scene::Drawable &d = scene.drawables.emplace_back(&t);
+		d.min = glm::vec3(0.0f);
+		d.max = glm::vec3(1.0f);
+	}
+	std::cout << count << " objects, " << queries << " queries of each type." << std::endl;
+
+	auto ms_since = [](std::chrono::steady_clock::time_point before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count();
+	};
+
+	DrawableBVH bvh;
+	{
+		auto before = std::chrono::steady_clock::now();
+		bvh.build(scene);
+		std::cout << "  build(): " << ms_since(before) << "ms (" << bvh.nodes.size() << " nodes)" << std::endl;
+	}
+	{
+		//(without update_world_caches(), so refit has to notice the moved groups on its own)
+		uint32_t i = 0;
+		for (auto &d : scene.drawables) {
+			if (i++ % 10 == 0) d.transform->position.z += 1.0f;
+		}
+		for (uint32_t g = 0; g < Groups; g += 8) {
+			groups[g]->position += glm::vec3(3.0f, -2.0f, 1.0f);
+		}
+		auto before = std::chrono::steady_clock::now();
+		bvh.update(scene);
+		std::cout << "  update() refitting " << (count + 9) / 10 << " moved objects and " << Groups / 8 << " moved groups: " << ms_since(before) << "ms" << std::endl;
+	}
+
+	//brute-force bounds of every drawable (boxes are unit cubes at their transform's world position):
+	// (computed from the positions directly, not from world caches, which are what's being tested)
+	struct Box {
+		Scene::Drawable const *drawable;
+		glm::vec3 min, max;
+	};
+	std::vector< Box > boxes;
+	for (auto const &d : scene.drawables) {
+		glm::vec3 at = d.transform->parent->position + d.transform->position;
+		boxes.emplace_back(Box{&d, at, at + glm::vec3(1.0f)});
+	}
+
+	bool ok = true;
+	auto check = [&ok](char const *label, std::vector< Scene::Drawable const * > &found, std::vector< Scene::Drawable const * > &expected) {
+		std::sort(found.begin(), found.end());
+		std::sort(expected.begin(), expected.end());
+		if (found != expected) {
+			std::cout << "ERROR: " << label << " query found " << found.size() << " drawables, expected " << expected.size() << "." << std::endl;
+			ok = false;
+		}
+	};
+	auto time = [&](char const *label, std::function< void(uint32_t) > const &query) {
+		auto before = std::chrono::steady_clock::now();
+		for (uint32_t q = 0; q < queries; ++q) query(q);
+		std::cout << "  " << label << ": " << 1000.0f * ms_since(before) / float(queries) << "us per query" << std::endl;
+	};
+
+	auto boxes_overlap = [](glm::vec3 const &min_a, glm::vec3 const &max_a, glm::vec3 const &min_b, glm::vec3 const &max_b) {
+		return min_a.x <= max_b.x && min_a.y <= max_b.y && min_a.z <= max_b.z
+		    && min_b.x <= max_a.x && min_b.y <= max_a.y && min_b.z <= max_a.z;
+	};
+
+	std::uniform_real_distribution< float > u(-Extent, Extent);
+
+	{ //rays (every fourth one axis-aligned, from a box corner):
+		std::vector< glm::vec3 > origins, directions;
+		for (uint32_t q = 0; q < queries; ++q) {
+			if (q % 4 == 0) {
+				origins.emplace_back(boxes[mt() % boxes.size()].min - glm::vec3(float(q % 3 == 0 ? 2 : 0), 0.0f, 0.0f));
+				glm::vec3 dir = glm::vec3(0.0f);
+				dir[q % 3] = (q % 8 == 0 ? 1.0f : -1.0f);
+				directions.emplace_back(dir);
+			} else {
+				origins.emplace_back(u(mt), u(mt), u(mt));
+				directions.emplace_back(glm::normalize(glm::vec3(u(mt), u(mt), u(mt))));
+			}
+		}
+		float max_t = 2.0f * Extent;
+		std::vector< DrawableBVH::RayHit > hits;
+		uint32_t total = 0;
+		time("query_ray()", [&](uint32_t q) {
+			hits.clear();
+			bvh.query_ray(origins[q], directions[q], max_t, &hits);
+			total += uint32_t(hits.size());
+		});
+		for (uint32_t q = 0; q < queries; ++q) {
+			hits.clear();
+			bvh.query_ray(origins[q], directions[q], max_t, &hits);
+			std::vector< Scene::Drawable const * > found, expected;
+			for (auto const &h : hits) {
+				if (!(h.t >= 0.0f && h.t <= max_t)) {
+					std::cout << "ERROR: ray hit at t = " << h.t << "." << std::endl;
+					ok = false;
+				}
+				found.emplace_back(h.drawable);
+			}
+			glm::vec3 const &o = origins[q];
+			glm::vec3 const &d = directions[q];
+			for (auto const &b : boxes) {
+				float enter = 0.0f, exit = max_t;
+				for (uint32_t a = 0; a < 3; ++a) {
+					if (d[a] == 0.0f) {
+						if (o[a] < b.min[a] || o[a] > b.max[a]) exit = -1.0f;
+					} else {
+						float t0 = (b.min[a] - o[a]) * (1.0f / d[a]);
+						float t1 = (b.max[a] - o[a]) * (1.0f / d[a]);
+						enter = std::max(enter, std::min(t0, t1));
+						exit = std::min(exit, std::max(t0, t1));
+					}
+				}
+				if (enter <= exit) expected.emplace_back(b.drawable);
+			}
+			check("ray", found, expected);
+		}
+		std::cout << "    (" << float(total) / float(queries) << " hits per ray)" << std::endl;
+	}
+
+	{ //boxes and spheres:
+		std::vector< glm::vec3 > centers;
+		for (uint32_t q = 0; q < queries; ++q) {
+			centers.emplace_back(u(mt), u(mt), u(mt));
+		}
+		constexpr float Radius = 40.0f;
+		std::vector< Scene::Drawable const * > found, expected;
+		time("query_box()", [&](uint32_t q) {
+			found.clear();
+			bvh.query_box(centers[q] - glm::vec3(Radius), centers[q] + glm::vec3(Radius), &found);
+		});
+		time("query_sphere()", [&](uint32_t q) {
+			found.clear();
+			bvh.query_sphere(centers[q], Radius, &found);
+		});
+		for (uint32_t q = 0; q < queries; ++q) {
+			glm::vec3 const &c = centers[q];
+			found.clear();
+			expected.clear();
+			bvh.query_box(c - glm::vec3(Radius), c + glm::vec3(Radius), &found);
+			for (auto const &b : boxes) {
+				if (boxes_overlap(b.min, b.max, c - glm::vec3(Radius), c + glm::vec3(Radius))) expected.emplace_back(b.drawable);
+			}
+			check("box", found, expected);
+
+			found.clear();
+			expected.clear();
+			bvh.query_sphere(c, Radius, &found);
+			for (auto const &b : boxes) {
+				glm::vec3 to_closest = glm::clamp(c, b.min, b.max) - c;
+				if (glm::dot(to_closest, to_closest) <= Radius * Radius) expected.emplace_back(b.drawable);
+			}
+			check("sphere", found, expected);
+		}
+	}
+
+	{ //frustum (an orthographic view volume, where the plane test is exact):
+		std::vector< Scene::Drawable const * > found, expected;
+		std::vector< glm::mat4 > world_to_clips;
+		std::vector< glm::vec3 > centers;
+		constexpr float Half = 50.0f;
+		for (uint32_t q = 0; q < queries; ++q) {
+			centers.emplace_back(u(mt), u(mt), u(mt));
+			glm::mat4 world_to_clip = glm::mat4(1.0f / Half);
+			world_to_clip[3] = glm::vec4(-centers.back() / Half, 1.0f);
+			world_to_clips.emplace_back(world_to_clip);
+		}
+		time("query_frustum()", [&](uint32_t q) {
+			found.clear();
+			bvh.query_frustum(world_to_clips[q], &found);
+		});
+		for (uint32_t q = 0; q < queries; ++q) {
+			glm::vec3 const &c = centers[q];
+			found.clear();
+			expected.clear();
+			bvh.query_frustum(world_to_clips[q], &found);
+			for (auto const &b : boxes) {
+				if (boxes_overlap(b.min, b.max, c - glm::vec3(Half), c + glm::vec3(Half))) expected.emplace_back(b.drawable);
+			}
+			check("frustum", found, expected);
+		}
+	}
+
+	if (!ok) {
+		std::cout << "ERROR: BVH queries disagree with brute force." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,192 @@
+//component-bench times a culling-style pass (enabled, layers, bounds) over many drawables stored:
+//  - in Scene::drawables, with pipelines kept apart as cold data (the current layout);
+//  - in an array of drawables with their pipelines inline;
+//  - in a std::list of drawables with their pipelines inline;
+// and checks that handles and cold data follow drawables through swap-removes and slot reuse;
+// then times copying the scene (which shares pipelines with the copy) against copying drawables with their pipelines,
+// and checks that neither copy sees the other's changes.
+//
+// usage: component-bench [drawables] [iterations]
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [drawables] [iterations]\nTimes passes over drawable storage layouts." << std::endl;
+		return 1;
+	}
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 200000);
+	uint32_t iterations = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 20);
+
+	//the old layout, for comparison:
+	struct InlineDrawable {
+		Scene::Drawable drawable;
+		Scene::Drawable::Pipeline pipeline;
+	};
+
+	Scene scene;
+	std::vector< InlineDrawable > inline_array;
+	std::list< InlineDrawable > inline_list;
+	std::vector< Handle > handles;
+	scene.transforms.emplace_back();
+	Scene::Transform *transform = &scene.transforms.back();
+	for (uint32_t i = 0; i < count; ++i) {
+		Scene::Drawable &d = scene.drawables.emplace_back(transform);
+		d.enabled = (i % 7 != 0);
+		d.layers = (i % 5 == 0 ? 2 : 1);
+		d.min = glm::vec3(float(i % 100));
+		d.max = d.min + glm::vec3(1.0f);
+		Scene::Drawable::Pipeline &p = scene.pipeline(d);
+		p.start = i; //(tag, to check that pipelines follow their drawables)
+		p.count = 3;
+		p.set_uniforms = [](){};
+		handles.emplace_back(scene.drawables.handle(d));
+		inline_array.emplace_back(InlineDrawable{d, p});
+		inline_list.emplace_back(InlineDrawable{d, p});
+	}
+	std::cout << count << " drawables, " << iterations << " iterations; sizeof(Drawable) = " << sizeof(Scene::Drawable)
+		<< ", sizeof(Drawable::Pipeline) = " << sizeof(Scene::Drawable::Pipeline) << " bytes." << std::endl;
+
+	//visible-ish test, as Scene::draw makes before touching a drawable's pipeline:
+	auto passes = [](Scene::Drawable const &d) {
+		return d.enabled && (d.layers & 1) && d.min.x <= d.max.x && d.max.x > 50.0f;
+	};
+
+	uint32_t expected = 0;
+	for (auto const &d : scene.drawables) {
+		if (passes(d)) ++expected;
+	}
+	bool ok = true;
+	auto time = [&](char const *label, std::function< uint32_t() > const &pass) {
+		std::vector< float > ns;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			auto before = std::chrono::steady_clock::now();
+			uint32_t found = pass();
+			ns.emplace_back(std::chrono::duration< float, std::nano >(std::chrono::steady_clock::now() - before).count() / float(count));
+			if (found != expected) {
+				std::cout << "ERROR: " << label << " found " << found << " drawables, expected " << expected << "." << std::endl;
+				ok = false;
+			}
+		}
+		std::sort(ns.begin(), ns.end());
+		std::cout << "  " << label << ": min " << ns[0] << "ns, median " << ns[ns.size() / 2] << "ns per drawable" << std::endl;
+	};
+	time("Scene::drawables (pipelines apart)", [&]() {
+		uint32_t found = 0;
+		for (auto const &d : scene.drawables) {
+			if (passes(d)) ++found;
+		}
+		return found;
+	});
+	time("array, pipelines inline", [&]() {
+		uint32_t found = 0;
+		for (auto const &d : inline_array) {
+			if (passes(d.drawable)) ++found;
+		}
+		return found;
+	});
+	time("list, pipelines inline", [&]() {
+		uint32_t found = 0;
+		for (auto const &d : inline_list) {
+			if (passes(d.drawable)) ++found;
+		}
+		return found;
+	});
+
+	//swap-remove every third drawable, then check survivors through their handles:
+	{
+		auto before = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < count; i += 3) {
+			scene.drawables.remove(handles[i]);
+		}
+		std::cout << "  remove() of every third drawable: "
+			<< std::chrono::duration< float, std::nano >(std::chrono::steady_clock::now() - before).count() / float((count + 2) / 3)
+			<< "ns per drawable" << std::endl;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		Scene::Drawable const *d = scene.drawables.get(handles[i]);
+		if ((i % 3 == 0) != (d == nullptr)) {
+			std::cout << "ERROR: handle " << i << " is " << (d ? "still valid" : "invalid") << "." << std::endl;
+			ok = false;
+			break;
+		}
+		if (d && (scene.drawables.cold(handles[i]).start != i || &scene.pipeline(*d) != &scene.drawables.cold(handles[i]))) {
+			std::cout << "ERROR: drawable " << i << " lost its pipeline." << std::endl;
+			ok = false;
+			break;
+		}
+	}
+	//slots are reused, but their cold data must start fresh:
+	{
+		Scene::Drawable &d = scene.drawables.emplace_back(transform);
+		Scene::Drawable::Pipeline const &p = scene.pipeline(d);
+		if (p.start != 0 || p.count != 0 || p.set_uniforms) {
+			std::cout << "ERROR: a reused slot kept its old pipeline." << std::endl;
+			ok = false;
+		}
+	}
+
+	//copies share pipelines until one of them changes a pipeline or its drawables:
+	{
+		auto time_copy = [&](char const *label, std::function< void() > const &copy) {
+			std::vector< float > ns;
+			for (uint32_t i = 0; i < iterations; ++i) {
+				auto before = std::chrono::steady_clock::now();
+				copy();
+				ns.emplace_back(std::chrono::duration< float, std::nano >(std::chrono::steady_clock::now() - before).count() / float(scene.drawables.size()));
+			}
+			std::sort(ns.begin(), ns.end());
+			std::cout << "  " << label << ": min " << ns[0] << "ns, median " << ns[ns.size() / 2] << "ns per drawable" << std::endl;
+		};
+		Scene copy;
+		time_copy("copy = scene (pipelines shared)", [&]() {
+			copy = Scene();
+			copy = scene;
+		});
+		std::vector< InlineDrawable > inline_copy;
+		time_copy("copy of array, pipelines inline", [&]() {
+			inline_copy.clear();
+			inline_copy.shrink_to_fit();
+			inline_copy = inline_array;
+		});
+
+		//(read through const references, so the checks don't themselves un-share the pipelines)
+		Scene const &source = scene;
+		Scene const &shared = copy;
+		auto fail = [&ok](char const *message) {
+			std::cout << "ERROR: " << message << std::endl;
+			ok = false;
+		};
+		if (&shared.pipeline(shared.drawables[0]) != &source.pipeline(source.drawables[0])) fail("a copy didn't share pipelines.");
+
+		//writing a pipeline gives the writer its own pipelines, and leaves the other scene's alone:
+		uint32_t kept = 1; //(a drawable that survived the removes above)
+		copy.drawables.cold(handles[kept]).count = 6;
+		if (copy.drawables.cold_shared() || scene.drawables.cold_shared()) fail("pipelines are still shared after a write.");
+		if (source.drawables.cold(handles[kept]).count != 3) fail("writing a copy's pipeline changed the source's.");
+		for (uint32_t i = 0; i < count; ++i) {
+			if (i % 3 == 0) continue;
+			if (shared.drawables.cold(handles[i]).start != i || !shared.drawables.cold(handles[i]).set_uniforms) {
+				fail("a pipeline didn't follow its drawable into the copy.");
+				break;
+			}
+		}
+
+		//removing a drawable from the source (which resets its pipeline) leaves the copy's alone:
+		copy = scene;
+		scene.drawables.remove(handles[kept]);
+		if (!shared.drawables.valid(handles[kept]) || shared.drawables.cold(handles[kept]).start != kept || !shared.drawables.cold(handles[kept]).set_uniforms) {
+			fail("removing a drawable from the source changed the copy's pipeline.");
+		}
+	}
+
+	return ok ? 0 : 1;
+}
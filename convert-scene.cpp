@@ -0,0 +1,76 @@
+//convert-scene converts version 1 .scene files (as written by scenes/export-scene.py)
+// to version 2 (see scene_format.hpp):
+//
+// usage: convert-scene <in.scene> <out.scene>
+
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+#include "scene_format.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.scene> <out.scene>\nConverts a version 1 scene file to version 2." << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+
+	try {
+		MappedFile file(in_filename);
+		if (SceneFormat::is_v2(file.begin(), file.end())) {
+			std::cerr << "'" << in_filename << "' is already a version 2 scene file." << std::endl;
+			return 1;
+		}
+
+		//read the version 1 chunk sequence:
+		ChunkReader reader(file.begin(), file.end());
+		auto copy = [](auto const &span) {
+			char const *begin = reinterpret_cast< char const * >(span.begin());
+			char const *end = reinterpret_cast< char const * >(span.end());
+			return std::vector< char >(begin, end);
+		};
+
+		std::vector< SceneFormat::Chunk > chunks;
+		ChunkSpan< char > names = reader.read< char >("str0");
+		chunks.push_back({"str0", 0, copy(names)});
+		ChunkSpan< SceneFormat::HierarchyEntry > hierarchy = reader.read< SceneFormat::HierarchyEntry >("xfh0");
+		chunks.push_back({"xfh0", 0, copy(hierarchy)});
+		chunks.push_back({"msh0", 0, copy(reader.read< SceneFormat::MeshEntry >("msh0"))});
+		chunks.push_back({"cam0", 0, copy(reader.read< SceneFormat::CameraEntry >("cam0"))});
+		chunks.push_back({"lmp0", 0, copy(reader.read< SceneFormat::LightEntry >("lmp0"))});
+
+		//precompute name hashes:
+		std::vector< uint32_t > hashes;
+		hashes.reserve(hierarchy.size());
+		for (auto const &h : hierarchy) {
+			if (!(h.name_begin <= h.name_end && h.name_end <= names.size())) {
+				throw std::runtime_error("hierarchy entry has invalid name indices");
+			}
+			hashes.emplace_back(SceneFormat::name_hash(names.data() + h.name_begin, names.data() + h.name_end));
+		}
+		ChunkSpan< uint32_t > hashes_span;
+		hashes_span.data_ = hashes.data();
+		hashes_span.size_ = hashes.size();
+		chunks.push_back({"nhs0", SceneFormat::TocFlagOptional, copy(hashes_span)});
+
+		//anything after the standard chunks is for Scene::load_extra:
+		if (!reader.at_end()) {
+			chunks.push_back({"ext0", SceneFormat::TocFlagOptional, std::vector< char >(reader.at, reader.end)});
+		}
+
+		std::ofstream out(out_filename, std::ios::binary);
+		SceneFormat::write_v2(chunks, &out);
+		if (!out) throw std::runtime_error("failed to write '" + out_filename + "'");
+
+		std::cout << "Wrote " << chunks.size() << " chunks (" << hierarchy.size() << " transforms) to '" << out_filename << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to convert '" << in_filename << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
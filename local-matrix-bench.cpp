@@ -0,0 +1,79 @@
+//local-matrix-bench times TransformStore::make_local_matrices (four transforms at a time with SSE, where available)
+// against computing each matrix on its own as Scene::Transform::make_local_to_parent does,
+// and checks that the two agree.
+//
+// usage: local-matrix-bench [transforms] [iterations]
+//
+// (the default count isn't a multiple of four, so the scalar tail of the batched version is checked too)
+
+#include "TransformStore.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [transforms] [iterations]\nTimes batched and one-at-a-time local matrix computation." << std::endl;
+		return 1;
+	}
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100003);
+	uint32_t iterations = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 20);
+
+	std::mt19937 mt(0x10ca1);
+	std::uniform_real_distribution< float > u(-1.0f, 1.0f);
+	std::vector< glm::vec3 > positions, scales;
+	std::vector< glm::quat > rotations;
+	for (uint32_t i = 0; i < count; ++i) {
+		positions.emplace_back(u(mt) * 100.0f, u(mt) * 100.0f, u(mt) * 100.0f);
+		rotations.emplace_back(glm::normalize(glm::quat(u(mt), u(mt), u(mt), u(mt))));
+		//(include some zero and negative scales)
+		scales.emplace_back((i % 97 == 0 ? 0.0f : 1.0f + 0.5f * u(mt)), 1.0f + 0.5f * u(mt), (i % 13 == 0 ? -1.0f : 1.0f));
+	}
+
+	std::cout << count << " transforms, " << iterations << " iterations." << std::endl;
+	auto time = [iterations, count](char const *label, std::function< void() > const &compute) {
+		std::vector< float > ns;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			auto before = std::chrono::steady_clock::now();
+			compute();
+			ns.emplace_back(std::chrono::duration< float, std::nano >(std::chrono::steady_clock::now() - before).count() / float(count));
+		}
+		std::sort(ns.begin(), ns.end());
+		std::cout << "  " << label << ": min " << ns[0] << "ns, median " << ns[ns.size() / 2] << "ns per transform" << std::endl;
+	};
+
+	std::vector< glm::mat4x3 > batched(count), single(count);
+	time("make_local_matrices()", [&]() {
+		TransformStore::make_local_matrices(count, positions.data(), rotations.data(), scales.data(), batched.data());
+	});
+	time("one at a time", [&]() {
+		for (uint32_t i = 0; i < count; ++i) {
+			//same computation as Scene::Transform::make_local_to_parent:
+			glm::mat3 rot = glm::mat3_cast(rotations[i]);
+			single[i] = glm::mat4x3(rot[0] * scales[i].x, rot[1] * scales[i].y, rot[2] * scales[i].z, positions[i]);
+		}
+	});
+
+	//rotation/scale columns are within a few units, translations within a hundred:
+	float max_difference = 0.0f;
+	for (uint32_t i = 0; i < count; ++i) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			for (uint32_t r = 0; r < 3; ++r) {
+				float scale = (c == 3 ? 100.0f : 1.0f);
+				max_difference = std::max(max_difference, std::abs(batched[i][c][r] - single[i][c][r]) / scale);
+			}
+		}
+	}
+	std::cout << "  max difference (relative to element range): " << max_difference << std::endl;
+	if (!(max_difference <= 1.0e-5f)) {
+		std::cout << "ERROR: batched and one-at-a-time matrices differ." << std::endl;
+		return 1;
+	}
+	return 0;
+}
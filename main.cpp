@@ -24,6 +24,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <string>
 #include <algorithm>
 
 #ifdef _WIN32
@@ -106,6 +107,12 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
+	for (int arg = 1; arg < argc; ++arg) {
+		if (std::string(argv[arg]) == "--audio-latency") {
+			//print play()-to-mix latency statistics on exit:
+			Sound::report_latency_at_shutdown = true;
+		}
+	}
 	Sound::init();
 
 	//------------ load assets --------------
@@ -163,6 +170,17 @@ int main(int argc, char **argv) {
 						px.a = 0xff;
 					}
 					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F9) {
+					// --- audio recording toggle key ---
+					if (Sound::is_recording()) {
+						Sound::stop_recording();
+					} else {
+						try {
+							Sound::start_recording("recording.wav");
+						} catch (std::exception &e) {
+							std::cerr << "Failed to start recording: " << e.what() << std::endl;
+						}
+					}
 				}
 			}
 			if (!Mode::current) break;
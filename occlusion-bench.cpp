@@ -0,0 +1,158 @@
+//occlusion-bench times OcclusionBuffer over a synthetic view of a wall of panels with gaps between them:
+//  - render(), serially and split across a WorkerPool;
+//  - occluded() for many small boxes scattered in front of and behind the wall;
+// and checks occluded() against the geometry: boxes that are clearly in front of the wall or show through
+// a gap must never be reported hidden, and boxes that are clearly behind a panel should be.
+//
+// usage: occlusion-bench [boxes] [iterations]
+//
+// ("clearly" leaves a one-pixel margin around panel edges, where rasterization rules decide)
+
+#include "OcclusionBuffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [boxes] [iterations]\nTimes and checks CPU occlusion culling." << std::endl;
+		return 1;
+	}
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000);
+	uint32_t iterations = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 20);
+
+	Scene scene;
+	scene.transforms.emplace_back();
+	Scene::Camera camera(&scene.transforms.back()); //at the origin, looking down -z
+	camera.aspect = 2.0f;
+	camera.near = 0.1f;
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+
+	//8x4 panels, 3 units on a side with 1-unit gaps, at z = -WallZ:
+	constexpr float WallZ = 20.0f;
+	struct Panel {
+		glm::vec2 min, max;
+	};
+	std::vector< Panel > panels;
+	std::vector< OcclusionBuffer::Occluder > occluders;
+	for (int32_t py = 0; py < 4; ++py) {
+		for (int32_t px = 0; px < 8; ++px) {
+			Panel panel;
+			panel.min = glm::vec2(-16.0f + 4.0f * float(px), -8.0f + 4.0f * float(py));
+			panel.max = panel.min + glm::vec2(3.0f);
+			panels.emplace_back(panel);
+
+			scene.transforms.emplace_back();
+			scene.transforms.back().position = glm::vec3(0.5f * (panel.min + panel.max), -WallZ);
+			occluders.emplace_back(OcclusionBuffer::make_box(&scene.transforms.back(), glm::vec3(-1.5f, -1.5f, -0.05f), glm::vec3(1.5f, 1.5f, 0.05f)));
+		}
+	}
+
+	OcclusionBuffer buffer;
+	WorkerPool pool;
+	std::cout << count << " boxes, " << occluders.size() << " occluders, " << buffer.width << "x" << buffer.height << " buffer, "
+		<< pool.size() << " worker threads (+ main thread)." << std::endl;
+
+	auto ms_since = [](std::chrono::steady_clock::time_point before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count();
+	};
+	auto time = [&](char const *label, WorkerPool *with) {
+		std::vector< float > ms;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			auto before = std::chrono::steady_clock::now();
+			buffer.render(world_to_clip, occluders, with);
+			ms.emplace_back(ms_since(before));
+		}
+		std::sort(ms.begin(), ms.end());
+		std::cout << "  " << label << ": min " << ms[0] << "ms, median " << ms[ms.size() / 2] << "ms ("
+			<< buffer.triangles_rasterized << " triangles)" << std::endl;
+	};
+	time("render()", nullptr);
+	time("render(pool)", &pool);
+
+	//small boxes around the wall:
+	std::mt19937 mt(0x0cc1);
+	std::uniform_real_distribution< float > ux(-25.0f, 25.0f), uy(-12.0f, 12.0f), uz(-2.0f * WallZ, -5.0f);
+	std::vector< glm::vec3 > mins;
+	constexpr float Size = 0.5f;
+	for (uint32_t i = 0; i < count; ++i) {
+		mins.emplace_back(ux(mt), uy(mt), uz(mt));
+	}
+
+	std::vector< bool > hidden(count);
+	{
+		auto before = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			hidden[i] = buffer.occluded(world_to_clip, mins[i], mins[i] + glm::vec3(Size));
+		}
+		std::cout << "  occluded(): " << 1.0e6f * ms_since(before) / float(count) << "ns per box" << std::endl;
+	}
+
+	//screen-space (pixel) rectangle of a world-space box, as OcclusionBuffer maps clip space to pixels:
+	auto screen_rect = [&](glm::vec3 const &min, glm::vec3 const &max, glm::vec2 *lo, glm::vec2 *hi) {
+		*lo = glm::vec2( std::numeric_limits< float >::infinity());
+		*hi = glm::vec2(-std::numeric_limits< float >::infinity());
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec4 clip = world_to_clip * glm::vec4((c & 1 ? max.x : min.x), (c & 2 ? max.y : min.y), (c & 4 ? max.z : min.z), 1.0f);
+			glm::vec2 at = glm::vec2(
+				(clip.x / clip.w * 0.5f + 0.5f) * float(buffer.width),
+				(clip.y / clip.w * 0.5f + 0.5f) * float(buffer.height)
+			);
+			*lo = glm::min(*lo, at);
+			*hi = glm::max(*hi, at);
+		}
+	};
+	std::vector< Panel > panel_rects; //(front faces of the panels, in pixels)
+	for (auto const &panel : panels) {
+		Panel rect;
+		screen_rect(glm::vec3(panel.min, -WallZ + 0.05f), glm::vec3(panel.max, -WallZ + 0.05f), &rect.min, &rect.max);
+		panel_rects.emplace_back(rect);
+	}
+
+	uint32_t wrongly_hidden = 0, behind = 0, behind_hidden = 0, on_screen = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec3 min = mins[i];
+		glm::vec3 max = mins[i] + glm::vec3(Size);
+		glm::vec2 lo, hi;
+		screen_rect(min, max, &lo, &hi);
+		if (hi.x < 0.0f || hi.y < 0.0f || lo.x > float(buffer.width) || lo.y > float(buffer.height)) continue;
+		on_screen += 1;
+		//clipped to the screen, since only the on-screen part can be seen:
+		lo = glm::max(lo, glm::vec2(0.0f));
+		hi = glm::min(hi, glm::vec2(float(buffer.width), float(buffer.height)));
+
+		bool inside_panel = false; //well inside one panel's rectangle
+		bool touches_gap = true; //not inside any panel's rectangle, even with a margin
+		for (auto const &rect : panel_rects) {
+			if (lo.x >= rect.min.x + 1.0f && lo.y >= rect.min.y + 1.0f && hi.x <= rect.max.x - 1.0f && hi.y <= rect.max.y - 1.0f) inside_panel = true;
+			if (lo.x >= rect.min.x - 1.0f && lo.y >= rect.min.y - 1.0f && hi.x <= rect.max.x + 1.0f && hi.y <= rect.max.y + 1.0f) touches_gap = false;
+		}
+		bool in_front = (max.z > -WallZ + 0.05f);
+		bool well_behind = (max.z < -WallZ - 0.5f);
+
+		if ((in_front || touches_gap) && hidden[i]) wrongly_hidden += 1;
+		if (well_behind && inside_panel) {
+			behind += 1;
+			if (hidden[i]) behind_hidden += 1;
+		}
+	}
+	uint32_t hidden_count = uint32_t(std::count(hidden.begin(), hidden.end(), true));
+	std::cout << "  " << hidden_count << " of " << on_screen << " on-screen boxes hidden; "
+		<< behind_hidden << " of " << behind << " boxes well behind a panel hidden." << std::endl;
+
+	bool ok = true;
+	if (wrongly_hidden) {
+		std::cout << "ERROR: " << wrongly_hidden << " visible boxes were reported hidden." << std::endl;
+		ok = false;
+	}
+	if (behind_hidden != behind) {
+		std::cout << "ERROR: " << (behind - behind_hidden) << " boxes behind a panel were not reported hidden." << std::endl;
+		ok = false;
+	}
+	return ok ? 0 : 1;
+}
@@ -4,6 +4,11 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -63,3 +68,86 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+
+//---------------------------------------------------------------------
+//In-place reading, for files that are already in memory (e.g., a MappedFile):
+
+//bounds-checked view of the elements of a chunk:
+template< typename T >
+struct ChunkSpan {
+	T const *data_ = nullptr;
+	size_t size_ = 0;
+
+	T const *data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	T const *begin() const { return data_; }
+	T const *end() const { return data_ + size_; }
+
+	T const &operator[](size_t i) const {
+		if (i >= size_) throw std::out_of_range("Chunk index out of range");
+		return data_[i];
+	}
+};
+
+//reads chunks in the format described above from [at, end):
+// read< T >(magic) returns a span pointing directly at the chunk's payload;
+// payloads not suitably aligned for T are first copied into (aligned) storage owned by the reader,
+// so spans are valid as long as both the reader and the underlying memory are.
+struct ChunkReader {
+	ChunkReader(char const *begin_, char const *end_) : at(begin_), end(end_) { }
+
+	template< typename T >
+	ChunkSpan< T > read(std::string const &magic) {
+		struct ChunkHeader {
+			char magic[4] = {'\0', '\0', '\0', '\0'};
+			uint32_t size = 0;
+		};
+		static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+		ChunkHeader header;
+		if (size_t(end - at) < sizeof(header)) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		std::memcpy(&header, at, sizeof(header));
+		if (std::string(header.magic,4) != magic) {
+			throw std::runtime_error("Unexpected magic number in chunk");
+		}
+
+		if (header.size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		if (size_t(end - at) - sizeof(header) < header.size) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		char const *payload = at + sizeof(header);
+		at = payload + header.size;
+
+		if (reinterpret_cast< uintptr_t >(payload) % alignof(T) != 0) {
+			static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "new[] storage is aligned enough for T");
+			copies.emplace_back(new char[header.size]);
+			std::memcpy(copies.back().get(), payload, header.size);
+			payload = copies.back().get();
+		}
+
+		ChunkSpan< T > span;
+		span.data_ = reinterpret_cast< T const * >(payload);
+		span.size_ = header.size / sizeof(T);
+		return span;
+	}
+
+	bool at_end() const { return at == end; }
+
+	char const *at; //start of the next chunk
+	char const *end; //end of data
+	std::vector< std::unique_ptr< char[] > > copies; //storage for misaligned payloads
+};
+
+//std::istream-compatible view of memory, for code that still wants a stream (e.g., Scene::load_extra):
+struct MemoryStreambuf : std::streambuf {
+	MemoryStreambuf(char const *begin, char const *end) {
+		//(streambuf's get area is non-const, but is never written through)
+		setg(const_cast< char * >(begin), const_cast< char * >(begin), const_cast< char * >(end));
+	}
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+/*
+ * Binary scene file formats read by Scene::load.
+ *
+ * Version 1 (written by scenes/export-scene.py) is a fixed sequence of chunks
+ *  in the format described in read_write_chunk.hpp:
+ *   str0 xfh0 msh0 cam0 lmp0 [data for Scene::load_extra]
+ *  which must be read in order, and whose payloads are not aligned.
+ *
+ * Version 2 (made from version 1 files by scenes/convert-scene) starts with
+ *  a table of contents, so chunks can be found directly (or skipped):
+ *   |Header|TocEntry * toc_count|payloads...|
+ *  Every payload starts at an offset that is a multiple of PayloadAlignment,
+ *  so payloads in a mapped file can be used in place.
+ *  Besides the version 1 chunks, version 2 files contain:
+ *   nhs0 - name_hash() of the name of each xfh0 entry (uint32 each)
+ *   ext0 - data for Scene::load_extra (if any)
+ *
+ * World files (made from version 2 scenes by scenes/split-world, and streamed
+ *  by WorldStream) are version 2 containers that divide a scene into square
+ *  cells in the xy plane, so each cell can be read on its own:
+ *   wld0 - WorldInfo (exactly one)
+ *   cel0 - CellEntry for each cell
+ *   cdat - one per cell: a complete version 2 scene with the cell's transforms, meshes, and lights
+ *  Each transform belongs to the cell containing the position of its root ancestor.
+ *
+ */
+
+#include "read_write_chunk.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace SceneFormat {
+
+//--- chunk contents (same in both versions) ---
+
+struct HierarchyEntry { //xfh0
+	uint32_t parent;
+	uint32_t name_begin;
+	uint32_t name_end;
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+
+struct MeshEntry { //msh0
+	uint32_t transform;
+	uint32_t name_begin;
+	uint32_t name_end;
+};
+static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+
+struct CameraEntry { //cam0
+	uint32_t transform;
+	char type[4]; //"pers" or "orth"
+	float data; //fov in degrees for 'pers', scale for 'orth'
+	float clip_near, clip_far;
+};
+static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
+
+struct LightEntry { //lmp0
+	uint32_t transform;
+	char type;
+	glm::u8vec3 color;
+	float energy;
+	float distance;
+	float fov;
+};
+static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
+
+//--- world files ---
+
+struct WorldInfo { //wld0
+	float cell_size; //cell (x,y) covers [x,x+1) * cell_size by [y,y+1) * cell_size
+	uint32_t flags; //(reserved; zero)
+};
+static_assert(sizeof(WorldInfo) == 4 + 4, "WorldInfo is packed.");
+
+struct CellEntry { //cel0
+	int32_t x, y; //cell coordinates
+	uint32_t toc_index; //TocEntry of the cell's cdat chunk
+	uint32_t transforms; //number of transforms in the cell (a hint for budgeting)
+};
+static_assert(sizeof(CellEntry) == 4 + 4 + 4 + 4, "CellEntry is packed.");
+
+//hash used for precomputed name hashes (32-bit FNV-1a):
+inline uint32_t name_hash(char const *begin, char const *end) {
+	uint32_t hash = 2166136261u;
+	for (char const *c = begin; c != end; ++c) {
+		hash = (hash ^ uint8_t(*c)) * 16777619u;
+	}
+	return hash;
+}
+inline uint32_t name_hash(std::string const &name) {
+	return name_hash(name.data(), name.data() + name.size());
+}
+
+//--- version 2 container ---
+
+struct Header {
+	char magic[4] = {'s','c','n','2'};
+	uint32_t version = 2;
+	uint32_t toc_count = 0; //TocEntry structures following header
+	uint32_t flags = 0; //(reserved; zero)
+};
+static_assert(sizeof(Header) == 16, "Header is packed.");
+
+struct TocEntry {
+	char type[4] = {'\0', '\0', '\0', '\0'}; //chunk type, e.g. "xfh0"
+	uint32_t flags = 0; //TocFlag* bits
+	uint32_t offset = 0; //from start of file; multiple of PayloadAlignment
+	uint32_t size = 0; //in bytes
+};
+static_assert(sizeof(TocEntry) == 16, "TocEntry is packed.");
+
+enum : uint32_t {
+	PayloadAlignment = 16,
+	TocFlagOptional = 1, //readers may load the scene without this chunk
+};
+
+//does [begin,end) hold a version 2 file?
+inline bool is_v2(char const *begin, char const *end) {
+	return size_t(end - begin) >= 4 && std::memcmp(begin, "scn2", 4) == 0;
+}
+
+//table of contents of a version 2 file in memory:
+// (memory must be at least PayloadAlignment-aligned, as a MappedFile is)
+struct Toc {
+	//checks header and every entry's range; throws on malformed files:
+	Toc(char const *begin_, char const *end_) : begin(begin_), end(end_) {
+		if (reinterpret_cast< uintptr_t >(begin) % PayloadAlignment != 0) {
+			throw std::runtime_error("Scene file data is not aligned in memory.");
+		}
+		if (size_t(end - begin) < sizeof(Header)) {
+			throw std::runtime_error("Failed to read scene file header.");
+		}
+		Header const &header = *reinterpret_cast< Header const * >(begin);
+		if (!is_v2(begin, end) || header.version != 2) {
+			throw std::runtime_error("Unexpected scene file header.");
+		}
+		if ((size_t(end - begin) - sizeof(Header)) / sizeof(TocEntry) < header.toc_count) {
+			throw std::runtime_error("Failed to read scene file table of contents.");
+		}
+		entries.data_ = reinterpret_cast< TocEntry const * >(begin + sizeof(Header));
+		entries.size_ = header.toc_count;
+		for (auto const &entry : entries) {
+			if (entry.offset % PayloadAlignment != 0) {
+				throw std::runtime_error("Chunk '" + std::string(entry.type, 4) + "' is not aligned.");
+			}
+			if (entry.offset > size_t(end - begin) || entry.size > size_t(end - begin) - entry.offset) {
+				throw std::runtime_error("Chunk '" + std::string(entry.type, 4) + "' extends past end of file.");
+			}
+		}
+	}
+
+	//first entry of a given type, or nullptr if none:
+	TocEntry const *find(std::string const &type) const {
+		assert(type.size() == 4);
+		for (auto const &entry : entries) {
+			if (std::memcmp(entry.type, type.data(), 4) == 0) return &entry;
+		}
+		return nullptr;
+	}
+
+	//contents of a chunk (throws if missing):
+	template< typename T >
+	ChunkSpan< T > read(std::string const &type) const {
+		TocEntry const *entry = find(type);
+		if (!entry) throw std::runtime_error("Missing chunk '" + type + "'.");
+		return span< T >(*entry);
+	}
+
+	//contents of a chunk (empty if missing):
+	template< typename T >
+	ChunkSpan< T > read_optional(std::string const &type) const {
+		TocEntry const *entry = find(type);
+		if (!entry) return ChunkSpan< T >();
+		return span< T >(*entry);
+	}
+
+	template< typename T >
+	ChunkSpan< T > span(TocEntry const &entry) const {
+		static_assert(alignof(T) <= PayloadAlignment, "payloads are aligned enough for T");
+		if (entry.size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		ChunkSpan< T > ret;
+		ret.data_ = reinterpret_cast< T const * >(begin + entry.offset);
+		ret.size_ = entry.size / sizeof(T);
+		return ret;
+	}
+
+	char const *begin;
+	char const *end;
+	ChunkSpan< TocEntry > entries;
+};
+
+//chunk to be written by write_v2:
+struct Chunk {
+	std::string type; //four characters
+	uint32_t flags = 0;
+	std::vector< char > data;
+};
+
+//write chunks (in the given order) as a version 2 file:
+inline void write_v2(std::vector< Chunk > const &chunks, std::ostream *to_) {
+	assert(to_);
+	auto &to = *to_;
+
+	auto align = [](size_t offset) {
+		return (offset + PayloadAlignment - 1) / PayloadAlignment * PayloadAlignment;
+	};
+
+	Header header;
+	header.toc_count = uint32_t(chunks.size());
+
+	std::vector< TocEntry > toc;
+	size_t offset = align(sizeof(Header) + chunks.size() * sizeof(TocEntry));
+	for (auto const &chunk : chunks) {
+		assert(chunk.type.size() == 4);
+		TocEntry entry;
+		std::memcpy(entry.type, chunk.type.data(), 4);
+		entry.flags = chunk.flags;
+		entry.offset = uint32_t(offset);
+		entry.size = uint32_t(chunk.data.size());
+		if (entry.offset != offset || entry.size != chunk.data.size()) {
+			throw std::runtime_error("Scene is too large for version 2 format.");
+		}
+		toc.emplace_back(entry);
+		offset = align(offset + chunk.data.size());
+	}
+
+	size_t written = 0;
+	auto pad_to = [&](size_t target) {
+		static char const zeros[PayloadAlignment] = { };
+		assert(target >= written && target - written < PayloadAlignment);
+		to.write(zeros, target - written);
+		written = target;
+	};
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(toc.data()), toc.size() * sizeof(TocEntry));
+	written = sizeof(header) + toc.size() * sizeof(TocEntry);
+	for (uint32_t i = 0; i < chunks.size(); ++i) {
+		pad_to(toc[i].offset);
+		to.write(chunks[i].data.data(), chunks[i].data.size());
+		written += chunks[i].data.size();
+	}
+	pad_to(align(written));
+}
+
+} //namespace SceneFormat
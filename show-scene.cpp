@@ -113,13 +113,17 @@ int main(int argc, char **argv) {
 
 				scene.drawables.emplace_back(transform);
 				Scene::Drawable &drawable = scene.drawables.back();
+				Scene::Drawable::Pipeline &pipeline = scene.pipeline(drawable);
 
-				drawable.pipeline = show_scene_program_pipeline;
+				pipeline = show_scene_program_pipeline;
 
-				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
+				pipeline.vao = buffer_vao;
+				pipeline.type = mesh.type;
+				pipeline.start = mesh.start;
+				pipeline.count = mesh.count;
+
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
 
 			});
 		} catch (std::exception &e) {
@@ -0,0 +1,12 @@
+#pragma once
+
+//SSE2 detection for the code paths that work on four floats at a time
+// (TransformStore's batched matrix math, OcclusionBuffer's rasterizer):
+//  SIMD_SSE2 is defined, and the SSE2 intrinsics are included, when compiling for a target that has SSE2
+//  (gcc/clang define __SSE2__; MSVC always has it on x64 and defines _M_IX86_FP on 32-bit x86);
+//  otherwise code should fall back to scalar loops.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
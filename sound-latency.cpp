@@ -0,0 +1,111 @@
+//sound-latency runs the mixer headless (no audio device) and reports how long it takes
+// from Sound::play() to the start of the block that first mixes the sample, for several
+// block sizes and for each Sound::LockStrategy:
+//
+// usage: sound-latency [seconds per configuration]
+//
+// A mixer thread calls Sound::mix() once per block period (as the device callback would)
+// while the main thread calls Sound::play() at irregular intervals. Fails (returns 1)
+// if any played sample was never mixed.
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [seconds per configuration]\nMeasures audio mixer latency without an audio device." << std::endl;
+		return 1;
+	}
+	float seconds = (argc == 2 ? std::stof(argv[1]) : 2.0f);
+
+	//a short tone to play:
+	std::vector< float > tone(4800);
+	for (uint32_t i = 0; i < tone.size(); ++i) {
+		tone[i] = 0.25f * std::sin(float(i) * (2.0f * 3.1415926f * 440.0f / 48000.0f));
+	}
+	Sound::Sample sample(tone);
+
+	struct Strategy {
+		Sound::LockStrategy strategy;
+		char const *name;
+	};
+	std::vector< Strategy > strategies{
+		{Sound::LockStrategy::Mutex, "mutex"},
+		{Sound::LockStrategy::Spin, "spin"},
+	};
+
+	std::mt19937 mt(0x5eed);
+	bool ok = true;
+
+	for (uint32_t samples : {256u, 512u, 1024u, 2048u}) {
+		for (auto const &s : strategies) {
+			Sound::init_headless(samples, s.strategy);
+			auto period = std::chrono::duration< double >(double(samples) / 48000.0);
+
+			//mixer thread stands in for the device callback:
+			std::atomic< bool > quit{false};
+			std::vector< float > mix_times;
+			std::thread mixer([&]() {
+				std::vector< float > buffer(2 * Sound::block_samples());
+				auto next = std::chrono::steady_clock::now();
+				while (!quit) {
+					auto before = std::chrono::steady_clock::now();
+					Sound::mix(buffer.data());
+					mix_times.emplace_back(std::chrono::duration< float >(std::chrono::steady_clock::now() - before).count());
+					next += std::chrono::duration_cast< std::chrono::steady_clock::duration >(period);
+					std::this_thread::sleep_until(next);
+				}
+			});
+
+			//play samples at irregular intervals, timing how long play() waits on the lock:
+			std::vector< std::shared_ptr< Sound::PlayingSample > > played;
+			std::vector< float > play_times;
+			std::uniform_int_distribution< int > gap(0, 20);
+			auto end = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< float >(seconds));
+			while (std::chrono::steady_clock::now() < end) {
+				auto before = std::chrono::steady_clock::now();
+				played.emplace_back(Sound::play(sample, 0.5f));
+				play_times.emplace_back(std::chrono::duration< float >(std::chrono::steady_clock::now() - before).count());
+				std::this_thread::sleep_for(std::chrono::milliseconds(gap(mt)));
+			}
+
+			//give the mixer a few blocks to reach the last samples:
+			std::this_thread::sleep_for(std::chrono::duration_cast< std::chrono::steady_clock::duration >(4.0 * period));
+			quit = true;
+			mixer.join();
+
+			uint32_t unmixed = 0;
+			for (auto const &p : played) {
+				if (!p->mixed) unmixed += 1;
+			}
+
+			auto report = [](char const *label, std::vector< float > &t) {
+				std::sort(t.begin(), t.end());
+				auto at = [&t](float f) { return 1000.0f * t[std::min(t.size() - 1, size_t(f * t.size()))]; };
+				std::cout << "  " << label << ": median " << at(0.5f) << "ms, 95% " << at(0.95f) << "ms, max " << at(1.0f) << "ms" << std::endl;
+			};
+			std::cout << "--- " << samples << "-sample blocks, " << s.name << " lock ---" << std::endl;
+			Sound::report_latency();
+			report("play() call", play_times);
+			report("mix() call", mix_times);
+			if (unmixed) {
+				std::cout << "  ERROR: " << unmixed << " of " << played.size() << " samples were never mixed." << std::endl;
+				ok = false;
+			}
+
+			played.clear();
+			Sound::shutdown();
+		}
+	}
+
+	return ok ? 0 : 1;
+}
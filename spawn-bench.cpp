@@ -0,0 +1,139 @@
+//spawn-bench times Scene::instantiate() and Scene::remove() by spawning and destroying many copies of a small prefab
+// (a root with a few children, some of them drawn), as a game placing and collecting items would:
+//  - spawning, then destroying, all instances with one call each;
+//  - a steady state where every frame destroys the oldest few instances and spawns as many new ones;
+// and checks that the name index, the drawables, and the transform pool stay consistent as it goes
+// (and that the name index is rebuilt after direct edits to the transform list).
+//
+// usage: spawn-bench [instances] [rounds]
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [instances] [rounds]\nTimes spawning and destroying prefab instances." << std::endl;
+		return 1;
+	}
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 10000);
+	uint32_t rounds = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 5);
+
+	//a level (some unrelated transforms) plus the prefab: Forage -> {Forage.Stem, Forage.Leaf -> Forage.Berry}
+	Scene scene;
+	for (uint32_t i = 0; i < 1000; ++i) {
+		scene.transforms.emplace_back();
+		scene.transforms.back().name = "Level." + std::to_string(i);
+	}
+	auto add = [&scene](std::string const &name, Scene::Transform *parent, bool drawn) {
+		scene.transforms.emplace_back();
+		Scene::Transform *t = &scene.transforms.back();
+		t->name = name;
+		t->parent = parent;
+		if (drawn) scene.drawables.emplace_back(t);
+		return t;
+	};
+	Scene::Transform *prefab = add("Forage", nullptr, false);
+	add("Forage.Stem", prefab, true);
+	Scene::Transform *leaf = add("Forage.Leaf", prefab, true);
+	add("Forage.Berry", leaf, true);
+	constexpr uint32_t PrefabTransforms = 4;
+	constexpr uint32_t PrefabDrawables = 3;
+	size_t base_transforms = scene.transforms.size();
+	size_t base_drawables = scene.drawables.size();
+
+	bool ok = true;
+	auto fail = [&ok](std::string const &message) {
+		std::cout << "ERROR: " << message << std::endl;
+		ok = false;
+	};
+	//the scene should hold the level, the prefab, and 'live' instances, all findable by name:
+	auto check = [&](char const *when, size_t live) {
+		if (scene.transforms.size() != base_transforms + live * PrefabTransforms) fail(std::string(when) + ": wrong number of transforms.");
+		if (scene.drawables.size() != base_drawables + live * PrefabDrawables) fail(std::string(when) + ": wrong number of drawables.");
+		bool current = (scene.name_index.valid && scene.name_index.count == scene.transforms.size());
+		std::vector< Scene::Transform * > found = scene.find_prefix("Forage");
+		if (!current) fail(std::string(when) + ": name index was not kept up to date.");
+		if (found.size() != (live + 1) * PrefabTransforms) fail(std::string(when) + ": find_prefix found " + std::to_string(found.size()) + " transforms.");
+		if (scene.find("Forage") != prefab) fail(std::string(when) + ": find no longer returns the prefab first.");
+		if (scene.find("Level.999") == nullptr) fail(std::string(when) + ": lost a level transform.");
+	};
+
+	auto ms_since = [](std::chrono::steady_clock::time_point before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count();
+	};
+
+	std::cout << count << " instances of a " << PrefabTransforms << "-transform prefab, " << rounds << " rounds." << std::endl;
+	scene.build_name_index();
+
+	std::vector< Scene::Transform * > instances;
+	std::vector< float > spawn_ms, destroy_ms;
+	size_t pool_after_first = 0;
+	size_t entries_after_first = 0;
+	for (uint32_t round = 0; round < rounds; ++round) {
+		auto before = std::chrono::steady_clock::now();
+		instances = scene.instantiate(prefab, nullptr, count);
+		for (uint32_t i = 0; i < count; ++i) {
+			instances[i]->position.x = float(i);
+		}
+		spawn_ms.emplace_back(ms_since(before));
+		check("after spawning", count);
+
+		before = std::chrono::steady_clock::now();
+		scene.remove(instances);
+		destroy_ms.emplace_back(ms_since(before));
+		instances.clear();
+		check("after destroying", 0);
+
+		//later rounds should run entirely out of the pool and the free name index entries:
+		if (round == 0) {
+			pool_after_first = scene.transform_pool.size();
+			entries_after_first = scene.name_index.entries.size();
+		} else if (scene.transform_pool.size() != pool_after_first || scene.name_index.entries.size() != entries_after_first) {
+			fail("storage grew after the first round.");
+		}
+	}
+	std::sort(spawn_ms.begin(), spawn_ms.end());
+	std::sort(destroy_ms.begin(), destroy_ms.end());
+	std::cout << "  spawn " << count << ": min " << spawn_ms[0] << "ms, median " << spawn_ms[spawn_ms.size() / 2] << "ms" << std::endl;
+	std::cout << "  destroy " << count << ": min " << destroy_ms[0] << "ms, median " << destroy_ms[destroy_ms.size() / 2] << "ms" << std::endl;
+
+	{ //steady state: a field of instances, some collected and respawned every frame
+		constexpr uint32_t PerFrame = 100;
+		std::deque< Scene::Transform * > live;
+		for (auto *instance : scene.instantiate(prefab, nullptr, count)) {
+			live.emplace_back(instance);
+		}
+		uint32_t frames = std::max(1u, rounds * count / PerFrame);
+		std::vector< Scene::Transform * > collected;
+		auto before = std::chrono::steady_clock::now();
+		for (uint32_t f = 0; f < frames; ++f) {
+			collected.assign(live.begin(), live.begin() + std::min< size_t >(PerFrame, live.size()));
+			live.erase(live.begin(), live.begin() + collected.size());
+			scene.remove(collected);
+			for (auto *instance : scene.instantiate(prefab, nullptr, uint32_t(collected.size()))) {
+				live.emplace_back(instance);
+			}
+		}
+		float ms = ms_since(before);
+		std::cout << "  steady state with " << count << " live, " << PerFrame << " destroyed and spawned per frame: "
+			<< ms / float(frames) << "ms per frame (" << float(frames * PerFrame) / (ms / 1000.0f) << " spawns+destroys per second)" << std::endl;
+		check("after steady state", live.size());
+
+		//direct list edits that leave the count unchanged still need the index marked out of date:
+		scene.transforms.pop_front(); //("Level.0", which has nothing attached)
+		scene.transforms.emplace_back();
+		scene.transforms.back().name = "Level.new";
+		scene.invalidate_name_index();
+		if (scene.find("Level.0") != nullptr) fail("found a transform erased directly from the list.");
+		if (scene.find("Level.new") != &scene.transforms.back()) fail("couldn't find a transform added directly to the list.");
+		check("after direct edits", live.size());
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+//split-world divides a version 2 .scene file into square cells in the xy plane,
+// making a world file that WorldStream can stream one cell at a time (see scene_format.hpp):
+//
+// usage: split-world <in.scene> <out.world> <cell size>
+//
+// Every transform goes in the cell that holds its root ancestor's position,
+// so each cell is a complete hierarchy. Cameras are not included in world files.
+
+#include "MappedFile.hpp"
+#include "read_write_chunk.hpp"
+#include "scene_format.hpp"
+
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if (argc != 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.scene> <out.world> <cell size>\nSplits a version 2 scene file into cells for streaming." << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+	float cell_size = std::stof(argv[3]);
+	if (!(cell_size > 0.0f)) {
+		std::cerr << "Cell size must be positive." << std::endl;
+		return 1;
+	}
+
+	try {
+		using namespace SceneFormat;
+
+		MappedFile file(in_filename);
+		if (!is_v2(file.begin(), file.end())) {
+			throw std::runtime_error("not a version 2 scene file (use convert-scene first)");
+		}
+		Toc toc(file.begin(), file.end());
+		ChunkSpan< char > names = toc.read< char >("str0");
+		ChunkSpan< HierarchyEntry > hierarchy = toc.read< HierarchyEntry >("xfh0");
+		ChunkSpan< MeshEntry > meshes = toc.read< MeshEntry >("msh0");
+		ChunkSpan< CameraEntry > cameras = toc.read< CameraEntry >("cam0");
+		ChunkSpan< LightEntry > lights = toc.read< LightEntry >("lmp0");
+
+		//cell contents, with entries renumbered within the cell:
+		struct CellContents {
+			std::vector< char > names;
+			std::vector< HierarchyEntry > hierarchy;
+			std::vector< MeshEntry > meshes;
+			std::vector< LightEntry > lights;
+			std::vector< uint32_t > hashes;
+
+			//copy a name into this cell's names:
+			void add_name(char const *begin, char const *end, uint32_t *name_begin, uint32_t *name_end) {
+				*name_begin = uint32_t(names.size());
+				names.insert(names.end(), begin, end);
+				*name_end = uint32_t(names.size());
+			}
+		};
+		std::map< std::pair< int32_t, int32_t >, CellContents > cells; //(ordered, so output is deterministic)
+
+		auto check_name = [&names](uint32_t name_begin, uint32_t name_end) {
+			if (!(name_begin <= name_end && name_end <= names.size())) {
+				throw std::runtime_error("entry has invalid name indices");
+			}
+		};
+
+		//cell coordinate along one axis (in double, so positions past what int32_t holds can be caught):
+		auto cell_coord = [&names, cell_size](HierarchyEntry const &h, float position) {
+			double c = std::floor(double(position) / double(cell_size));
+			if (!(c >= double(INT32_MIN) && c <= double(INT32_MAX))) {
+				throw std::runtime_error("root transform '" + std::string(names.data() + h.name_begin, names.data() + h.name_end)
+					+ "' has a position (" + std::to_string(position) + ") that is not finite or is too far out to fit in a cell");
+			}
+			return int32_t(c);
+		};
+
+		//assign transforms to cells by their root's position:
+		std::vector< CellContents * > cell_of(hierarchy.size(), nullptr);
+		std::vector< uint32_t > local_index(hierarchy.size(), -1U);
+		for (uint32_t i = 0; i < hierarchy.size(); ++i) {
+			HierarchyEntry const &h = hierarchy[i];
+			check_name(h.name_begin, h.name_end);
+			CellContents *cell;
+			if (h.parent == -1U) {
+				auto key = std::make_pair(cell_coord(h, h.position.x), cell_coord(h, h.position.y));
+				cell = &cells[key];
+			} else {
+				if (h.parent >= i) throw std::runtime_error("transforms are not in topological-sort order");
+				cell = cell_of[h.parent];
+			}
+			cell_of[i] = cell;
+			local_index[i] = uint32_t(cell->hierarchy.size());
+
+			HierarchyEntry entry = h;
+			entry.parent = (h.parent == -1U ? -1U : local_index[h.parent]);
+			cell->add_name(names.data() + h.name_begin, names.data() + h.name_end, &entry.name_begin, &entry.name_end);
+			cell->hierarchy.emplace_back(entry);
+			cell->hashes.emplace_back(name_hash(names.data() + h.name_begin, names.data() + h.name_end));
+		}
+
+		for (auto const &m : meshes) {
+			if (m.transform >= hierarchy.size()) throw std::runtime_error("mesh entry has invalid transform index");
+			check_name(m.name_begin, m.name_end);
+			CellContents *cell = cell_of[m.transform];
+			MeshEntry entry = m;
+			entry.transform = local_index[m.transform];
+			cell->add_name(names.data() + m.name_begin, names.data() + m.name_end, &entry.name_begin, &entry.name_end);
+			cell->meshes.emplace_back(entry);
+		}
+
+		for (auto const &l : lights) {
+			if (l.transform >= hierarchy.size()) throw std::runtime_error("lamp entry has invalid transform index");
+			LightEntry entry = l;
+			entry.transform = local_index[l.transform];
+			cell_of[l.transform]->lights.emplace_back(entry);
+		}
+
+		auto bytes = [](auto const &vec) {
+			char const *begin = reinterpret_cast< char const * >(vec.data());
+			return std::vector< char >(begin, begin + vec.size() * sizeof(vec[0]));
+		};
+
+		//each cell is written as a complete version 2 scene, which becomes one cdat chunk of the world:
+		std::vector< Chunk > chunks;
+		std::vector< WorldInfo > info{WorldInfo{cell_size, 0}};
+		chunks.push_back({"wld0", 0, bytes(info)});
+		chunks.push_back({"cel0", 0, {}}); //(filled in below)
+		std::vector< CellEntry > entries;
+		for (auto const &kv : cells) {
+			CellContents const &cell = kv.second;
+			std::vector< Chunk > cell_chunks;
+			cell_chunks.push_back({"str0", 0, cell.names});
+			cell_chunks.push_back({"xfh0", 0, bytes(cell.hierarchy)});
+			cell_chunks.push_back({"msh0", 0, bytes(cell.meshes)});
+			cell_chunks.push_back({"cam0", 0, {}});
+			cell_chunks.push_back({"lmp0", 0, bytes(cell.lights)});
+			cell_chunks.push_back({"nhs0", TocFlagOptional, bytes(cell.hashes)});
+			std::ostringstream cell_data;
+			write_v2(cell_chunks, &cell_data);
+			std::string const &data = cell_data.str();
+
+			CellEntry entry;
+			entry.x = kv.first.first;
+			entry.y = kv.first.second;
+			entry.toc_index = uint32_t(chunks.size());
+			entry.transforms = uint32_t(cell.hierarchy.size());
+			entries.emplace_back(entry);
+			chunks.push_back({"cdat", 0, std::vector< char >(data.begin(), data.end())});
+		}
+		chunks[1].data = bytes(entries);
+
+		std::ofstream out(out_filename, std::ios::binary);
+		write_v2(chunks, &out);
+		if (!out) throw std::runtime_error("failed to write '" + out_filename + "'");
+
+		std::cout << "Wrote " << cells.size() << " cells (" << hierarchy.size() << " transforms) to '" << out_filename << "'." << std::endl;
+		if (!cameras.empty()) {
+			std::cout << "Note: " << cameras.size() << " camera(s) were not included." << std::endl;
+		}
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to split '" << in_filename << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
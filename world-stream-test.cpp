@@ -0,0 +1,218 @@
+//world-stream-test writes a synthetic world file and streams it with WorldStream, moving the focus around the world
+// with several loader threads and a small memory budget, checking every frame that:
+//  - the scene's name index stays up to date as cells are attached and evicted, and finds each attached cell;
+//  - a cell with a corrupt cdat chunk is reported once, never throws, and is never retried;
+//  - cells with missing or wrong name hashes are still found by name;
+//  - memory and transform storage stay bounded;
+//  - a non-finite or far-away focus is handled.
+//
+// usage: world-stream-test [cells per side] [laps]
+
+#include "WorldStream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [cells per side] [laps]\nStreams a synthetic world and checks the scene as it goes." << std::endl;
+		return 1;
+	}
+	int32_t side = (argc > 1 ? int32_t(std::stoul(argv[1])) : 12);
+	uint32_t laps = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 3);
+	side = std::max(side, 4);
+
+	using namespace SceneFormat;
+	constexpr float CellSize = 10.0f;
+	constexpr uint32_t CellTransforms = 24;
+	//(the world is centered on the origin, so it has cells with negative coordinates)
+	int32_t first = -side / 2;
+	glm::ivec2 corrupt = glm::ivec2(first + 1, first + 1);
+	glm::ivec2 wrong_hash = glm::ivec2(first + 2, first + 1);
+
+	auto bytes = [](auto const &vec) {
+		char const *begin = reinterpret_cast< char const * >(vec.data());
+		return std::vector< char >(begin, begin + vec.size() * sizeof(vec[0]));
+	};
+	auto transform_name = [](int32_t x, int32_t y, uint32_t i) {
+		//(the last transform of every cell shares a name, so the index has long chains to unlink)
+		if (i + 1 == CellTransforms) return std::string("Shared");
+		return "c" + std::to_string(x) + "," + std::to_string(y) + "." + std::to_string(i);
+	};
+
+	std::string filename = std::string(argv[0]) + ".world";
+	{ //write the world, as split-world would:
+		std::vector< Chunk > chunks;
+		std::vector< WorldInfo > info{WorldInfo{CellSize, 0}};
+		chunks.push_back({"wld0", 0, bytes(info)});
+		chunks.push_back({"cel0", 0, {}}); //(filled in below)
+		std::vector< CellEntry > entries;
+		for (int32_t y = first; y < first + side; ++y) {
+			for (int32_t x = first; x < first + side; ++x) {
+				std::vector< char > names;
+				std::vector< HierarchyEntry > hierarchy;
+				std::vector< MeshEntry > meshes;
+				std::vector< LightEntry > lights;
+				std::vector< uint32_t > hashes;
+				for (uint32_t i = 0; i < CellTransforms; ++i) {
+					std::string name = transform_name(x, y, i);
+					HierarchyEntry h;
+					h.parent = (i == 0 ? -1U : (i - 1) / 2);
+					h.name_begin = uint32_t(names.size());
+					names.insert(names.end(), name.begin(), name.end());
+					h.name_end = uint32_t(names.size());
+					h.position = (i == 0 ? glm::vec3((glm::vec2(x, y) + 0.5f) * CellSize, 0.0f) : glm::vec3(0.1f, 0.0f, 0.0f));
+					h.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+					h.scale = glm::vec3(1.0f);
+					hierarchy.emplace_back(h);
+					hashes.emplace_back(name_hash(name));
+					if (i % 2 == 0) meshes.emplace_back(MeshEntry{i, h.name_begin, h.name_end});
+				}
+				lights.emplace_back(LightEntry{0, 'p', glm::u8vec3(255), 1.0f, 10.0f, 45.0f});
+				if (glm::ivec2(x, y) == wrong_hash) hashes[0] ^= 1;
+
+				std::vector< Chunk > cell_chunks;
+				cell_chunks.push_back({"str0", 0, names});
+				cell_chunks.push_back({"xfh0", 0, bytes(hierarchy)});
+				cell_chunks.push_back({"msh0", 0, bytes(meshes)});
+				cell_chunks.push_back({"cam0", 0, {}});
+				cell_chunks.push_back({"lmp0", 0, bytes(lights)});
+				//(some cells have no hashes, so the loader threads compute them)
+				if ((x + y) % 3 != 0) cell_chunks.push_back({"nhs0", TocFlagOptional, bytes(hashes)});
+				std::ostringstream cell_data;
+				write_v2(cell_chunks, &cell_data);
+				std::string data = cell_data.str();
+				if (glm::ivec2(x, y) == corrupt) data.assign(data.size(), char(0xab));
+
+				entries.emplace_back(CellEntry{x, y, uint32_t(chunks.size()), CellTransforms});
+				chunks.push_back({"cdat", 0, std::vector< char >(data.begin(), data.end())});
+			}
+		}
+		chunks[1].data = bytes(entries);
+		std::ofstream out(filename, std::ios::binary);
+		write_v2(chunks, &out);
+		if (!out) {
+			std::cerr << "Failed to write '" << filename << "'." << std::endl;
+			return 1;
+		}
+	}
+
+	bool ok = true;
+	auto fail = [&ok](std::string const &message) {
+		std::cout << "ERROR: " << message << std::endl;
+		ok = false;
+	};
+
+	Scene scene;
+	scene.transforms.emplace_back();
+	scene.transforms.back().name = "Player";
+	scene.build_name_index(); //(from here on, attaching and evicting cells should keep it up to date)
+	uint32_t drawables_made = 0;
+	{
+		WorldStream stream(filename, scene, [&drawables_made](Scene &s, Scene::Transform *t, std::string const &) {
+			s.drawables.emplace_back(t);
+			++drawables_made;
+		}, 3);
+		stream.load_radius = 1.5f * CellSize;
+		stream.attach_budget = 2 * CellTransforms;
+		stream.memory_budget = 30 * CellTransforms * sizeof(Scene::Transform);
+
+		//the focus circles the world 'laps' times, passing over the corrupt cell each lap:
+		uint32_t frames_per_lap = uint32_t(side) * 40;
+		float radius = (float(side) / 2.0f - 1.5f) * CellSize;
+		size_t peak_storage = 0;
+		uint32_t max_resident = 0;
+		auto check = [&](std::string const &when) {
+			bool current = (scene.name_index.valid && scene.name_index.count == scene.transforms.size());
+			if (!current) fail(when + ": name index was not kept up to date.");
+			uint32_t attached = 0;
+			for (auto const &cell : stream.cells) {
+				if (cell.state != WorldStream::Cell::Attached) continue;
+				++attached;
+				std::string name = "cell " + std::to_string(cell.coord.x) + "," + std::to_string(cell.coord.y);
+				if (scene.find(name) != cell.root) fail(when + ": couldn't find '" + name + "'.");
+				std::string first_name = transform_name(cell.coord.x, cell.coord.y, 0);
+				Scene::Transform *t = scene.find(first_name);
+				if (!t || t->parent != cell.root) fail(when + ": couldn't find '" + first_name + "'.");
+			}
+			if (scene.find_prefix("Shared").size() != attached) fail(when + ": wrong number of 'Shared' transforms.");
+			if (scene.find("Player") != &scene.transforms.front()) fail(when + ": lost the player.");
+			if (scene.name_index.count != scene.transforms.size()) fail(when + ": a lookup had to rebuild the name index.");
+			if (scene.transforms.size() != 1 + attached * (CellTransforms + 1)) fail(when + ": wrong number of transforms.");
+			if (stream.stats.failed > 1) fail(when + ": " + std::to_string(stream.stats.failed) + " failed cells.");
+
+			//parsed cells beyond load_radius are only kept while under the memory budget:
+			if (stream.stats.resident_bytes > stream.memory_budget) {
+				for (uint32_t index : stream.resident) {
+					if (stream.cells[index].distance > stream.load_radius) {
+						fail(when + ": over memory budget with cells outside load_radius resident.");
+						break;
+					}
+				}
+			}
+			max_resident = std::max(max_resident, stream.stats.resident);
+		};
+
+		for (uint32_t lap = 0; lap < laps; ++lap) {
+			for (uint32_t f = 0; f < frames_per_lap; ++f) {
+				float angle = float(f) / float(frames_per_lap) * 2.0f * 3.1415926f;
+				glm::vec3 focus = glm::vec3(radius * std::cos(angle), radius * std::sin(angle), 0.0f);
+				try {
+					stream.update(focus);
+				} catch (std::exception const &e) {
+					fail(std::string("update() threw: ") + e.what());
+					break;
+				}
+				check("lap " + std::to_string(lap) + ", frame " + std::to_string(f));
+				if (!ok) break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1)); //(give the loaders a frame's worth of time)
+			}
+			if (!ok) break;
+			//(transform storage only grows when more transforms are live than ever before, so it should level off after a lap)
+			size_t storage = scene.transforms.size() + scene.transform_pool.size();
+			if (lap == 0) peak_storage = storage;
+			else if (storage > peak_storage + 8 * (CellTransforms + 1)) fail("transform storage kept growing: " + std::to_string(storage) + " after lap " + std::to_string(lap) + ", " + std::to_string(peak_storage) + " after the first.");
+		}
+
+		//sit on the corrupt cell:
+		if (ok) {
+			try {
+				stream.finish(glm::vec3((glm::vec2(corrupt) + 0.5f) * CellSize, 0.0f));
+			} catch (std::exception const &e) {
+				fail(std::string("finish() threw: ") + e.what());
+			}
+			check("after finish()");
+			auto const &cell = stream.cells[stream.cell_index.at(WorldStream::cell_key(corrupt.x, corrupt.y))];
+			if (cell.state != WorldStream::Cell::Failed) fail("the corrupt cell was not marked as failed.");
+			if (stream.stats.failed != 1) fail("expected one failed cell, got " + std::to_string(stream.stats.failed) + ".");
+			auto const &wrong = stream.cells[stream.cell_index.at(WorldStream::cell_key(wrong_hash.x, wrong_hash.y))];
+			if (wrong.state != WorldStream::Cell::Attached) fail("the cell with a wrong name hash was not attached.");
+		}
+
+		//a non-finite or far-away focus wants no cells (and shouldn't overflow the cell range):
+		float inf = std::numeric_limits< float >::infinity();
+		for (glm::vec3 focus : {glm::vec3(std::nanf(""), 0.0f, 0.0f), glm::vec3(inf, -inf, 0.0f), glm::vec3(3.0e38f, -3.0e38f, 0.0f), glm::vec3(0.0f)}) {
+			try {
+				stream.update(focus);
+				if (!(focus == glm::vec3(0.0f)) && (stream.stats.queued != 0 || stream.stats.attached != 0)) fail("a far-away focus wanted cells.");
+			} catch (std::exception const &e) {
+				fail(std::string("update() with a far-away focus threw: ") + e.what());
+			}
+			check("with a far-away focus");
+		}
+		std::cout << side << "x" << side << " cells, " << laps << " laps: at most " << max_resident << " cells resident, "
+			<< drawables_made << " drawables made, " << stream.stats.failed << " failed cell(s)." << std::endl;
+	}
+
+	std::remove(filename.c_str());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+//world-update-bench times world matrix updates over a large synthetic hierarchy:
+//  - TransformStore::update_world(), serially and split across a WorkerPool;
+//  - Scene::update_world_caches(), serially and with a WorkerPool (which mirrors the scene into a TransformStore);
+// and checks that the serial and parallel results agree, and that world matrix queries see an ancestor's change
+// without waiting for update_world_caches().
+//
+// usage: world-update-bench [transforms] [iterations]
+//
+// Every iteration turns every root a little, so every world matrix changes.
+
+#include "Scene.hpp"
+#include "TransformStore.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [transforms] [iterations]\nTimes serial and parallel world matrix updates." << std::endl;
+		return 1;
+	}
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000);
+	uint32_t iterations = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 20);
+
+	//random hierarchy: each transform's parent is a random earlier transform (so depth grows like log(count)),
+	// except for a few roots:
+	Scene scene;
+	{
+		std::mt19937 mt(0xc0ffee);
+		std::uniform_real_distribution< float > u(-1.0f, 1.0f);
+		std::vector< Scene::Transform * > added;
+		added.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			scene.transforms.emplace_back();
+			Scene::Transform &t = scene.transforms.back();
+			t.position = glm::vec3(u(mt), u(mt), u(mt)) * 4.0f;
+			t.rotation = glm::normalize(glm::quat(u(mt), u(mt), u(mt), u(mt)));
+			t.scale = glm::vec3(1.0f + 0.1f * u(mt));
+			if (i >= 16) t.parent = added[mt() % i];
+			added.emplace_back(&t);
+		}
+	}
+	std::vector< Scene::Transform * > roots;
+	for (auto &t : scene.transforms) {
+		if (!t.parent) roots.emplace_back(&t);
+	}
+
+	WorkerPool pool;
+	std::cout << count << " transforms, " << roots.size() << " roots, " << iterations << " iterations, "
+		<< pool.size() << " worker threads (+ main thread)." << std::endl;
+
+	auto time = [iterations](char const *label, std::function< void() > const &step, std::function< void() > const &update) {
+		std::vector< float > ms;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			step();
+			auto before = std::chrono::steady_clock::now();
+			update();
+			ms.emplace_back(std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count());
+		}
+		std::sort(ms.begin(), ms.end());
+		std::cout << "  " << label << ": min " << ms[0] << "ms, median " << ms[ms.size() / 2] << "ms" << std::endl;
+	};
+	auto max_difference = [](glm::mat4x3 const &a, glm::mat4x3 const &b) {
+		float diff = 0.0f;
+		for (uint32_t c = 0; c < 4; ++c) {
+			for (uint32_t r = 0; r < 3; ++r) {
+				diff = std::max(diff, std::abs(a[c][r] - b[c][r]));
+			}
+		}
+		return diff;
+	};
+	glm::quat const turn = glm::angleAxis(0.01f, glm::vec3(0.0f, 0.0f, 1.0f));
+
+	bool ok = true;
+
+	{ //TransformStore:
+		TransformStore serial, parallel;
+		serial.set(scene);
+		parallel.set(scene);
+		std::vector< uint32_t > store_roots;
+		for (uint32_t i = 0; i < serial.size(); ++i) {
+			if (serial.parents[i] == -1U) store_roots.emplace_back(i);
+		}
+		std::cout << "TransformStore:" << std::endl;
+		time("update_world()", [&]() {
+			for (uint32_t r : store_roots) serial.rotations[r] = turn * serial.rotations[r];
+		}, [&]() {
+			serial.update_world();
+		});
+		time("update_world(pool)", [&]() {
+			for (uint32_t r : store_roots) parallel.rotations[r] = turn * parallel.rotations[r];
+		}, [&]() {
+			parallel.update_world(pool);
+		});
+		float diff = 0.0f;
+		for (uint32_t i = 0; i < serial.size(); ++i) {
+			diff = std::max(diff, max_difference(serial.local_to_world[i], parallel.local_to_world[i]));
+		}
+		std::cout << "  max difference: " << diff << std::endl;
+		if (diff != 0.0f) ok = false;
+	}
+
+	{ //Scene:
+		Scene parallel = scene;
+		std::vector< Scene::Transform * > parallel_roots;
+		for (auto &t : parallel.transforms) {
+			if (!t.parent) parallel_roots.emplace_back(&t);
+		}
+		std::cout << "Scene:" << std::endl;
+		time("update_world_caches()", [&]() {
+			for (auto r : roots) r->rotation = turn * r->rotation;
+		}, [&]() {
+			scene.update_world_caches();
+		});
+		time("update_world_caches(pool)", [&]() {
+			for (auto r : parallel_roots) r->rotation = turn * r->rotation;
+		}, [&]() {
+			parallel.update_world_caches(pool);
+		});
+		float diff = 0.0f;
+		auto p = parallel.transforms.begin();
+		for (auto const &t : scene.transforms) {
+			diff = std::max(diff, max_difference(t.world_cache.local_to_world, p->world_cache.local_to_world));
+			++p;
+		}
+		std::cout << "  max difference: " << diff << std::endl;
+		//(the parallel pass computes local matrices with SSE, so small rounding differences are expected)
+		if (!(diff < 1e-3f)) ok = false;
+	}
+
+	if (!ok) {
+		std::cout << "ERROR: serial and parallel results differ." << std::endl;
+		return 1;
+	}
+
+	{ //queries between update_world_caches() calls:
+		//the deepest transform, and the world matrix computed without any caches:
+		Scene::Transform *leaf = &scene.transforms.front();
+		auto depth = [](Scene::Transform const *t) {
+			uint32_t d = 0;
+			for (; t; t = t->parent) ++d;
+			return d;
+		};
+		for (auto &t : scene.transforms) {
+			if (depth(&t) > depth(leaf)) leaf = &t;
+		}
+		auto uncached = [](Scene::Transform const *t) {
+			glm::mat4 m = glm::mat4(1.0f);
+			for (; t; t = t->parent) m = glm::mat4(t->make_local_to_parent()) * m;
+			return glm::mat4x3(m);
+		};
+		auto check = [&](char const *when) {
+			glm::mat4x3 expected = uncached(leaf);
+			float scale = std::max(1.0f, glm::length(expected[3]));
+			float diff = max_difference(leaf->make_local_to_world(), expected) / scale;
+			glm::mat4 round_trip = glm::mat4(leaf->make_world_to_local()) * glm::mat4(leaf->make_local_to_world());
+			diff = std::max(diff, max_difference(glm::mat4x3(round_trip), glm::mat4x3(1.0f)));
+			glm::mat3 normal = glm::inverse(glm::transpose(glm::mat3(expected)));
+			diff = std::max(diff, max_difference(glm::mat4x3(leaf->make_normal_to_world()), glm::mat4x3(normal)));
+			if (!(diff < 1e-3f)) {
+				std::cout << "ERROR: " << when << ", the leaf's cached matrices are off by " << diff << "." << std::endl;
+				ok = false;
+			}
+			if (leaf->cached_enabled_in_hierarchy() != leaf->enabled_in_hierarchy()) {
+				std::cout << "ERROR: " << when << ", the leaf's cached enabled state is wrong." << std::endl;
+				ok = false;
+			}
+		};
+		Scene::Transform *root = leaf;
+		while (root->parent) root = root->parent;
+
+		scene.update_world_caches();
+		check("after update_world_caches()");
+		leaf->parent->position += glm::vec3(1.0f, 2.0f, 3.0f);
+		check("after moving the parent");
+		root->rotation = turn * root->rotation;
+		check("after turning the root");
+		leaf->parent->parent->scale *= 2.0f;
+		check("after scaling the grandparent");
+		root->enabled = false;
+		check("after disabling the root");
+		root->enabled = true;
+		check("after enabling the root");
+		Scene::Transform *old_parent = leaf->parent;
+		leaf->parent = root;
+		check("after reparenting the leaf");
+		leaf->parent = old_parent;
+
+		//cost of a query when nothing changed (one comparison per ancestor):
+		scene.update_world_caches();
+		std::vector< float > ns;
+		float sum = 0.0f; //(checked below, so the queries aren't optimized away)
+		for (uint32_t i = 0; i < iterations; ++i) {
+			auto before = std::chrono::steady_clock::now();
+			for (auto const &t : scene.transforms) sum += t.make_local_to_world()[3].x;
+			ns.emplace_back(std::chrono::duration< float, std::nano >(std::chrono::steady_clock::now() - before).count() / float(count));
+		}
+		std::sort(ns.begin(), ns.end());
+		std::cout << "make_local_to_world() on current caches (deepest chain " << depth(leaf) << "): min " << ns[0]
+			<< "ns, median " << ns[ns.size() / 2] << "ns per transform" << std::endl;
+		if (!std::isfinite(sum)) {
+			std::cout << "ERROR: world positions aren't finite." << std::endl;
+			ok = false;
+		}
+	}
+
+	if (!ok) return 1;
+	return 0;
+}